@@ -0,0 +1,433 @@
+#include "config.h"
+#include "scene.h"
+#include "grid.h"
+#include "bvh.h"
+#include "mbp.h"
+#include "octree.h"
+#include "jobs.h"
+#include "oracle.h"
+#include "narrowphase.h"
+#include "physics.h"
+#include "rigidbody.h"
+#include "scenegen.h"
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <new>
+#include <random>
+#include <string>
+#include <vector>
+
+//headless broadphase benchmark, only needs the scene/partition sources so it links without GLFW, GLAD or ImGui.
+//also writes generated scenes, see printUsage
+
+//every allocation carries its size in front so the current and peak heap use can be tracked
+static std::atomic<size_t> currentBytes{ 0 };
+static std::atomic<size_t> peakBytes{ 0 };
+constexpr size_t allocationHeader = alignof(std::max_align_t);
+
+void* operator new(size_t size) {
+    char* block = static_cast<char*>(std::malloc(size + allocationHeader));
+    if (!block) throw std::bad_alloc();
+    *reinterpret_cast<size_t*>(block) = size;
+    size_t current = currentBytes.fetch_add(size) + size;
+    size_t peak = peakBytes.load();
+    while (current > peak && !peakBytes.compare_exchange_weak(peak, current)) {}
+    return block + allocationHeader;
+}
+
+void operator delete(void* pointer) noexcept {
+    if (!pointer) return;
+    char* block = static_cast<char*>(pointer) - allocationHeader;
+    currentBytes.fetch_sub(*reinterpret_cast<size_t*>(block));
+    std::free(block);
+}
+
+void operator delete(void* pointer, size_t) noexcept {
+    operator delete(pointer);
+}
+
+struct BenchScene {
+    std::string name;
+    SceneData data;
+    glm::vec3 boundsMin{ 0.0f }; //movers bounce around inside these
+    glm::vec3 boundsMax{ 0.0f };
+};
+
+struct BenchResult {
+    double loadNs = 0.0;
+    double insertNs = 0.0;
+    double updateNs = 0.0;
+    double removeNs = 0.0;
+    double rayNs = 0.0; //closest hit, batched
+    double pairsPerSecond = 0.0;
+    double pairsPerSecondParallel = 0.0;
+    size_t pairsPerFrame = 0;
+    size_t peakBytes = 0;
+    long long mismatches = -1; //missing plus extra pairs after churn, -1 when not checked
+};
+
+struct PartitionEntry {
+    const char* name;
+    std::function<std::unique_ptr<SpatialPartition>()> create;
+    bool quadratic; //only run on small scenes
+};
+
+const uint32_t maxQuadraticEntities = 5000;
+const uint32_t maxOverlappingEntities = 2000; //every pair overlaps so pair count grows with the square
+const uint32_t maxChurnEntities = 1000; //removed and inserted again one by one after the frames
+const uint32_t narrowphasePairs = 1 << 18;
+const uint32_t narrowphaseRepeats = 20;
+const uint32_t integrationBodies = 100000;
+const uint32_t integrationSteps = 100;
+const uint32_t stepEntities = 10000;
+const uint32_t stepFrames = 100;
+const uint32_t benchRays = 4096; //segments between random points in the scene bounds, cast after the frames
+
+//movers are kept inside the box around everything in the scene
+static BenchScene makeBenchScene(const std::string& name, SceneData data) {
+    BenchScene scene;
+    scene.name = name;
+    scene.data = std::move(data);
+    if (!scene.data.positions.empty()) {
+        scene.boundsMin = scene.boundsMax = scene.data.positions[0];
+        for (const glm::vec3& pos : scene.data.positions) {
+            scene.boundsMin = glm::min(scene.boundsMin, pos);
+            scene.boundsMax = glm::max(scene.boundsMax, pos);
+        }
+    }
+    return scene;
+}
+
+//spheres only so everything moves
+static BenchScene generatedScene(SceneLayout layout, uint32_t count) {
+    SceneParams params;
+    params.count = count;
+    params.layout = layout;
+    params.sphereFraction = 1.0f;
+    params.seed = 42;
+    return makeBenchScene(getLayoutName(layout), generateScene(params));
+}
+
+//big spheres jittering inside a box smaller than any of them, every pair overlaps every frame
+static BenchScene overlappingScene(uint32_t count, std::mt19937& rng) {
+    SceneData data;
+    count = std::min(count, maxOverlappingEntities);
+    std::uniform_real_distribution<float> position(-0.5f, 0.5f);
+    for (uint32_t i = 0; i < count; i++) {
+        data.boundTypes.push_back(BoundType::Sphere);
+        data.positions.push_back(glm::vec3(position(rng), position(rng), position(rng)));
+        data.scales.push_back(glm::vec3(2.0f));
+    }
+    return makeBenchScene("overlapping", std::move(data));
+}
+
+//one static floor box under every mover, the worst case for partitions that walk overlaps along an axis
+static BenchScene floorScene(uint32_t count, std::mt19937& rng) {
+    SceneData data;
+    float halfWidth = 1.5f * std::sqrt(static_cast<float>(count));
+    std::uniform_real_distribution<float> position(-halfWidth, halfWidth);
+    std::uniform_real_distribution<float> height(0.0f, 0.5f);
+    std::uniform_real_distribution<float> radius(0.2f, 0.5f);
+    for (uint32_t i = 1; i < count; i++) {
+        data.boundTypes.push_back(BoundType::Sphere);
+        data.positions.push_back(glm::vec3(position(rng), height(rng), position(rng)));
+        data.scales.push_back(glm::vec3(radius(rng)));
+    }
+    BenchScene scene = makeBenchScene("floor", std::move(data));
+    scene.data.boundTypes.push_back(BoundType::AABB);
+    scene.data.positions.push_back(glm::vec3(0.0f, -0.5f, 0.0f));
+    scene.data.scales.push_back(glm::vec3(2.0f * halfWidth, 1.0f, 2.0f * halfWidth));
+    return scene;
+}
+
+template<typename Func>
+static double timeNs(Func func) {
+    auto start = std::chrono::high_resolution_clock::now();
+    func();
+    auto finish = std::chrono::high_resolution_clock::now();
+    return static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(finish - start).count());
+}
+
+static BenchResult runBenchmark(const PartitionEntry& entry, const BenchScene& scene, uint32_t frames, JobSystem& jobs) {
+    BenchResult result;
+    size_t baseline = currentBytes.load();
+    peakBytes.store(baseline);
+    {
+        std::unique_ptr<SpatialPartition> partition = entry.create();
+        EntityManager entityManager{ *partition };
+        const SceneData& data = scene.data;
+        uint32_t count = static_cast<uint32_t>(data.positions.size());
+        uint32_t first = 0;
+        double loadTime = timeNs([&] {
+            first = entityManager.createEntities(std::vector<Mesh>(count), data.boundTypes, data.positions, data.scales);
+            partition->flushUpdates(); //some partitions only sort on the first flush
+        });
+        result.loadNs = loadTime / count;
+        std::vector<uint32_t> movers;
+        for (uint32_t i = 0; i < count; i++) {
+            if (data.boundTypes[i] == BoundType::Sphere) movers.push_back(first + i);
+        }
+        std::mt19937 rng(1234);
+        std::uniform_real_distribution<float> direction(-1.0f, 1.0f);
+        std::vector<glm::vec3> velocities(movers.size());
+        for (glm::vec3& velocity : velocities) velocity = glm::vec3(direction(rng), direction(rng), direction(rng)) * 0.05f;
+        std::vector<CollisionPair> pairs;
+        WorkerPairs workerPairs;
+        double updateTime = 0.0, pairTime = 0.0, parallelPairTime = 0.0;
+        size_t pairsFound = 0;
+        for (uint32_t frame = 0; frame < frames; frame++) {
+            updateTime += timeNs([&] {
+                for (size_t i = 0; i < movers.size(); i++) {
+                    glm::vec3 pos = entityManager.gameEntities.at(movers[i]).getPos() + velocities[i];
+                    for (int axis = 0; axis < 3; axis++) {
+                        if (pos[axis] < scene.boundsMin[axis] || pos[axis] > scene.boundsMax[axis]) velocities[i][axis] = -velocities[i][axis];
+                    }
+                    pos = glm::clamp(pos, scene.boundsMin, scene.boundsMax);
+                    entityManager.setPos(movers[i], pos);
+                }
+                partition->flushUpdates();
+            });
+            pairs.clear();
+            pairTime += timeNs([&] { partition->getCollisionPairs(pairs); });
+            pairsFound += pairs.size();
+            pairs.clear();
+            parallelPairTime += timeNs([&] { partition->getCollisionPairs(pairs, jobs, workerPairs); });
+        }
+        result.updateNs = movers.empty() ? 0.0 : updateTime / (static_cast<double>(movers.size()) * frames);
+        result.pairsPerFrame = pairsFound / frames;
+        result.pairsPerSecond = pairTime > 0.0 ? pairsFound / (pairTime * 1e-9) : 0.0;
+        result.pairsPerSecondParallel = parallelPairTime > 0.0 ? pairsFound / (parallelPairTime * 1e-9) : 0.0;
+        std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+        auto randomPoint = [&] {
+            return scene.boundsMin + glm::vec3(unit(rng), unit(rng), unit(rng)) * (scene.boundsMax - scene.boundsMin);
+        };
+        std::vector<Ray> rays;
+        for (uint32_t i = 0; i < benchRays; i++) {
+            glm::vec3 origin = randomPoint();
+            rays.push_back(Ray(origin, randomPoint() - origin, 1.0f));
+        }
+        std::vector<RayHit> hits;
+        result.rayNs = timeNs([&] { partition->rayCastBatch(rays, hits); }) / benchRays;
+        //one by one removes and inserts into the populated partition, like entities despawning and spawning
+        size_t churn = std::min<size_t>(std::max<size_t>(movers.size() / 100, 1), maxChurnEntities);
+        churn = std::min(churn, movers.size());
+        std::vector<glm::vec3> churnPositions(churn), churnScales(churn);
+        for (size_t i = 0; i < churn; i++) {
+            const GameEntity& entity = entityManager.gameEntities.at(movers[i]);
+            churnPositions[i] = entity.getPos();
+            churnScales[i] = entity.getScale();
+        }
+        double removeTime = timeNs([&] {
+            for (size_t i = 0; i < churn; i++) entityManager.destroyEntity(movers[i]);
+            partition->flushUpdates();
+        });
+        Mesh mesh;
+        double insertTime = timeNs([&] {
+            for (size_t i = 0; i < churn; i++) entityManager.createEntity(mesh, BoundType::Sphere, churnPositions[i], churnScales[i]);
+            partition->flushUpdates();
+        });
+        result.removeNs = churn ? removeTime / churn : 0.0;
+        result.insertNs = churn ? insertTime / churn : 0.0;
+        result.peakBytes = peakBytes.load() - baseline;
+        //the oracle holds every pair it expects, so it runs after the peak is taken
+        if (!entry.quadratic) {
+            BroadphaseOracle oracle;
+            pairs.clear();
+            partition->getCollisionPairs(pairs);
+            oracle.check(entityManager, pairs);
+            result.mismatches = static_cast<long long>(oracle.getMissing().size() + oracle.getExtra().size());
+        }
+    }
+    return result;
+}
+
+//random pairs among boxes and spheres packed closely enough that roughly half of them overlap, through
+//the one pair at a time intersect and then every kernel this CPU has
+static void benchNarrowphase() {
+    std::mt19937 rng(7);
+    std::uniform_real_distribution<float> position(-4.0f, 4.0f);
+    std::uniform_real_distribution<float> size(0.2f, 2.0f);
+    const uint32_t volumes = 4096;
+    std::vector<AABB> aabbs(volumes / 2);
+    std::vector<BoundingSphere> spheres(volumes / 2);
+    std::vector<BoundingVolumePair> all;
+    for (uint32_t i = 0; i < aabbs.size(); i++) {
+        aabbs[i].center = glm::vec3(position(rng), position(rng), position(rng));
+        aabbs[i].halfExtent = glm::vec3(size(rng), size(rng), size(rng));
+        all.push_back(BoundingVolumePair{ 2 * i, &aabbs[i].volume });
+        spheres[i].center = glm::vec3(position(rng), position(rng), position(rng));
+        spheres[i].radius = size(rng);
+        all.push_back(BoundingVolumePair{ 2 * i + 1, &spheres[i].volume });
+    }
+    std::uniform_int_distribution<uint32_t> pick(0, volumes - 1);
+    std::vector<CollisionPair> pairs(narrowphasePairs);
+    for (CollisionPair& pair : pairs) pair = CollisionPair{ all[pick(rng)], all[pick(rng)] };
+    std::vector<char> expected(pairs.size());
+    size_t overlapping = 0;
+    double pairTime = timeNs([&] {
+        for (uint32_t repeat = 0; repeat < narrowphaseRepeats; repeat++) {
+            for (size_t i = 0; i < pairs.size(); i++) expected[i] = pairs[i].first.second->intersect(pairs[i].second.second);
+        }
+    });
+    for (char hit : expected) overlapping += hit;
+    std::cout << std::endl << "narrowphase (" << pairs.size() << " pairs, " << overlapping << " overlapping)" << std::endl;
+    std::cout << std::left << std::setw(18) << "kernel" << std::right << std::setw(12) << "ns/pair" << std::setw(12) << "mismatches" << std::endl;
+    std::cout << std::left << std::setw(18) << "per pair" << std::right << std::setw(12) << pairTime / (static_cast<double>(pairs.size()) * narrowphaseRepeats) << std::setw(12) << "-" << std::endl;
+    Narrowphase narrowphase;
+    std::vector<uint64_t> hits;
+    for (int k = 0; k <= static_cast<int>(Narrowphase::getBestKernel()); k++) {
+        Narrowphase::Kernel kernel = static_cast<Narrowphase::Kernel>(k);
+        narrowphase.setKernel(kernel);
+        double time = timeNs([&] {
+            for (uint32_t repeat = 0; repeat < narrowphaseRepeats; repeat++) narrowphase.test(pairs, hits);
+        });
+        size_t mismatches = 0;
+        for (size_t i = 0; i < pairs.size(); i++) mismatches += Narrowphase::isHit(hits, i) != (expected[i] != 0);
+        std::cout << std::left << std::setw(18) << Narrowphase::getKernelName(kernel) << std::right << std::setw(12) << time / (static_cast<double>(pairs.size()) * narrowphaseRepeats)
+            << std::setw(12) << mismatches << std::endl;
+    }
+    //manifolds for the hits of the last kernel, per pair tested so the rows compare
+    std::vector<ContactManifold> contacts;
+    double contactTime = timeNs([&] {
+        for (uint32_t repeat = 0; repeat < narrowphaseRepeats; repeat++) Narrowphase::generateContacts(pairs, hits, contacts);
+    });
+    size_t mismatches = 0;
+    for (size_t i = 0; i < pairs.size(); i++) mismatches += (contacts[i].pointCount > 0) != (expected[i] != 0);
+    std::cout << std::left << std::setw(18) << "contacts" << std::right << std::setw(12) << contactTime / (static_cast<double>(pairs.size()) * narrowphaseRepeats)
+        << std::setw(12) << mismatches << std::endl;
+}
+
+//both halves of the semi-implicit Euler step over the body arrays, a tenth of the bodies kinematic
+static void benchIntegration() {
+    RigidBodies bodies;
+    bodies.reserve(integrationBodies);
+    for (uint32_t i = 0; i < integrationBodies; i++) {
+        bodies.add(i, glm::vec3(static_cast<float>(i), 0.0f, 0.0f), i % 10 ? 1.0f : 0.0f, 0.5f, 0.5f, glm::vec3(1.0f, 2.0f, 3.0f));
+    }
+    double time = timeNs([&] {
+        for (uint32_t step = 0; step < integrationSteps; step++) {
+            bodies.integrateVelocities(1.0f / 60.0f, glm::vec3(0.0f, gravity, 0.0f));
+            bodies.integratePositions(1.0f / 60.0f);
+        }
+    });
+    std::cout << std::endl << "integration (" << bodies.size() << " bodies): " << time / integrationSteps / 1000.0 << " us/step" << std::endl;
+}
+
+//whole PhysicsManager::step over the floor scene's spheres dropping onto the floor: broadphase, narrowphase,
+//solver and the write-back to the entities and the partition
+static void benchStep() {
+    std::mt19937 rng(42);
+    BenchScene scene = floorScene(stepEntities, rng);
+    const SceneData& data = scene.data;
+    uint32_t count = static_cast<uint32_t>(data.positions.size());
+    SortedAABBList partition;
+    EntityManager entityManager{ partition };
+    uint32_t first = entityManager.createEntities(std::vector<Mesh>(count), data.boundTypes, data.positions, data.scales);
+    PhysicsManager physicsManager;
+    physicsManager.verifyInterval = 0;
+    for (uint32_t i = 0; i < count; i++) physicsManager.addBody(entityManager, first + i, 1.0f, 0.5f, 0.5f); //the floor gets none
+    double time = timeNs([&] {
+        for (uint32_t frame = 0; frame < stepFrames; frame++) physicsManager.step(entityManager, 1.0f / 60.0f);
+    });
+    std::cout << "step (" << physicsManager.rigidBodies.size() << " bodies): " << time / stepFrames / 1000.0 << " us/step" << std::endl;
+}
+
+static void printUsage() {
+    std::cerr << "usage: Benchmark [entities >= 2] [frames >= 1]" << std::endl;
+    std::cerr << "       Benchmark scene <path> [frames >= 1]" << std::endl;
+    std::cerr << "       Benchmark generate <path> <entities> [uniform|clusters|towers|lattice|heavy] [sphere fraction] [seed] [spacing]" << std::endl;
+}
+
+static int generate(int argc, char* argv[]) {
+    if (argc < 4) {
+        printUsage();
+        return EXIT_FAILURE;
+    }
+    SceneParams params;
+    params.count = static_cast<uint32_t>(std::strtoul(argv[3], nullptr, 10));
+    if (argc > 4 && !parseLayout(argv[4], params.layout)) {
+        std::cerr << "Unknown layout: " << argv[4] << std::endl;
+        return EXIT_FAILURE;
+    }
+    if (argc > 5) params.sphereFraction = std::strtof(argv[5], nullptr);
+    if (argc > 6) params.seed = static_cast<uint32_t>(std::strtoul(argv[6], nullptr, 10));
+    if (argc > 7) params.spacing = std::strtof(argv[7], nullptr);
+    if (!writeScene(argv[2], generateScene(params))) return EXIT_FAILURE;
+    std::cout << "Wrote " << params.count << " entities (" << getLayoutName(params.layout) << ", seed " << params.seed << ") to " << argv[2] << std::endl;
+    return EXIT_SUCCESS;
+}
+
+int main(int argc, char* argv[]) {
+    if (argc > 1 && std::string(argv[1]) == "generate") return generate(argc, argv);
+    std::vector<BenchScene> scenes;
+    uint32_t frames = 100;
+    if (argc > 1 && std::string(argv[1]) == "scene") {
+        SceneData data;
+        if (argc < 3 || !readScene(argv[2], data) || data.positions.size() < 2) {
+            printUsage();
+            return EXIT_FAILURE;
+        }
+        if (argc > 3) frames = static_cast<uint32_t>(std::strtoul(argv[3], nullptr, 10));
+        scenes.push_back(makeBenchScene(argv[2], std::move(data)));
+    }
+    else {
+        uint32_t entities = argc > 1 ? static_cast<uint32_t>(std::strtoul(argv[1], nullptr, 10)) : 10000;
+        if (argc > 2) frames = static_cast<uint32_t>(std::strtoul(argv[2], nullptr, 10));
+        if (entities < 2) {
+            printUsage();
+            return EXIT_FAILURE;
+        }
+        std::mt19937 rng(42);
+        scenes.push_back(generatedScene(SceneLayout::Uniform, entities));
+        scenes.push_back(generatedScene(SceneLayout::Clusters, entities));
+        scenes.push_back(overlappingScene(entities, rng));
+        scenes.push_back(floorScene(entities, rng));
+    }
+    if (frames == 0) {
+        printUsage();
+        return EXIT_FAILURE;
+    }
+    std::vector<PartitionEntry> partitions = {
+        { "NullPartition", [] { return std::unique_ptr<SpatialPartition>(new NullPartition); }, true },
+        { "SortedAABBList", [] { return std::unique_ptr<SpatialPartition>(new SortedAABBList); }, false },
+        { "SortedAABBArray", [] { return std::unique_ptr<SpatialPartition>(new SortedAABBArray); }, false },
+        { "SortedAABBArray x", [] { return std::unique_ptr<SpatialPartition>(new SortedAABBArray(0)); }, false }, //pinned to x, to see what the axis choice buys
+        { "SpatialHashGrid", [] { return std::unique_ptr<SpatialPartition>(new SpatialHashGrid); }, false },
+        { "AABBTree", [] { return std::unique_ptr<SpatialPartition>(new AABBTree); }, false },
+        { "HierarchicalGrid", [] { return std::unique_ptr<SpatialPartition>(new HierarchicalGrid); }, false },
+        { "LooseOctree", [] { return std::unique_ptr<SpatialPartition>(new LooseOctree); }, false },
+        { "MultiBoxPruning", [] { return std::unique_ptr<SpatialPartition>(new MultiBoxPruning(16.0f)); }, false }, //bench scenes are small, shrink the regions so there are some
+    };
+    JobSystem jobs;
+    std::cout << frames << " frames, " << jobs.getWorkerCount() << " workers for the parallel pair pass" << std::endl;
+    std::cout << std::fixed << std::setprecision(1);
+    for (const BenchScene& scene : scenes) {
+        size_t count = scene.data.positions.size();
+        std::cout << std::endl << scene.name << " (" << count << " entities)" << std::endl;
+        std::cout << std::left << std::setw(18) << "partition" << std::right << std::setw(12) << "load ns"
+            << std::setw(12) << "insert ns" << std::setw(12) << "update ns" << std::setw(12) << "remove ns" << std::setw(12) << "ray ns"
+            << std::setw(12) << "pairs" << std::setw(14) << "Mpairs/s" << std::setw(14) << "Mpairs/s mt" << std::setw(12) << "peak MB" << std::setw(12) << "mismatches" << std::endl;
+        for (const PartitionEntry& entry : partitions) {
+            std::cout << std::left << std::setw(18) << entry.name << std::right;
+            if (entry.quadratic && count > maxQuadraticEntities) {
+                std::cout << "   skipped, too many entities" << std::endl;
+                continue;
+            }
+            BenchResult result = runBenchmark(entry, scene, frames, jobs);
+            std::cout << std::setw(12) << result.loadNs << std::setw(12) << result.insertNs << std::setw(12) << result.updateNs << std::setw(12) << result.removeNs << std::setw(12) << result.rayNs
+                << std::setw(12) << result.pairsPerFrame << std::setw(14) << result.pairsPerSecond * 1e-6
+                << std::setw(14) << result.pairsPerSecondParallel * 1e-6 << std::setw(12) << result.peakBytes / (1024.0 * 1024.0);
+            if (result.mismatches < 0) std::cout << std::setw(12) << "-" << std::endl;
+            else std::cout << std::setw(12) << result.mismatches << std::endl;
+        }
+    }
+    benchNarrowphase();
+    benchIntegration();
+    benchStep();
+    return EXIT_SUCCESS;
+}
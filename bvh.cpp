@@ -0,0 +1,420 @@
+#include "bvh.h"
+#include "jobs.h"
+#include <algorithm>
+
+static inline float surfaceArea(const glm::vec3& min, const glm::vec3& max) {
+	glm::vec3 d = max - min;
+	return 2.0f * (d.x * d.y + d.y * d.z + d.z * d.x);
+}
+
+static inline bool overlap(const glm::vec3& first_min, const glm::vec3& first_max, const glm::vec3& second_min, const glm::vec3& second_max) {
+	if (first_min.x > second_max.x || second_min.x > first_max.x) return false;
+	if (first_min.y > second_max.y || second_min.y > first_max.y) return false;
+	if (first_min.z > second_max.z || second_min.z > first_max.z) return false;
+	return true;
+}
+
+static inline bool rayBox(const glm::vec3& origin, const glm::vec3& invDirection, float maxDistance, const glm::vec3& min, const glm::vec3& max) {
+	glm::vec3 t1 = (min - origin) * invDirection;
+	glm::vec3 t2 = (max - origin) * invDirection;
+	glm::vec3 tmin = glm::min(t1, t2);
+	glm::vec3 tmax = glm::max(t1, t2);
+	float enter = std::max(std::max(tmin.x, tmin.y), std::max(tmin.z, 0.0f));
+	float exit = std::min(std::min(tmax.x, tmax.y), std::min(tmax.z, maxDistance));
+	return enter <= exit;
+}
+
+uint32_t AABBTree::allocateNode() {
+	if (freeList == nullNode) {
+		nodes.emplace_back();
+		return static_cast<uint32_t>(nodes.size() - 1);
+	}
+	uint32_t node = freeList;
+	freeList = nodes[node].parent;
+	nodes[node] = Node{};
+	return node;
+}
+
+void AABBTree::freeNode(uint32_t node) {
+	nodes[node] = Node{};
+	nodes[node].parent = freeList;
+	freeList = node;
+}
+
+ProxyHandle AABBTree::insert(uint32_t entityIndex, BoundingVolume* boundingVolume) {
+	assert(boundingVolume);
+	uint32_t leaf = allocateNode();
+	Node& node = nodes[leaf];
+	node.index = entityIndex;
+	node.boundingVolume = boundingVolume;
+	node.height = 0;
+	node.tightMin = boundingVolume->getCenter() - boundingVolume->getHalfExtent();
+	node.tightMax = boundingVolume->getCenter() + boundingVolume->getHalfExtent();
+	node.min = node.tightMin - glm::vec3(margin);
+	node.max = node.tightMax + glm::vec3(margin);
+	insertLeaf(leaf);
+	return leaf;
+}
+
+bool AABBTree::remove(ProxyHandle proxy) {
+	if (proxy >= nodes.size() || nodes[proxy].height != 0) return false;
+	removeLeaf(proxy);
+	freeNode(proxy);
+	return true;
+}
+
+bool AABBTree::update(ProxyHandle proxy) {
+	if (proxy >= nodes.size() || nodes[proxy].height != 0) return false;
+	uint32_t leaf = proxy;
+	Node& node = nodes[leaf];
+	node.tightMin = node.boundingVolume->getCenter() - node.boundingVolume->getHalfExtent();
+	node.tightMax = node.boundingVolume->getCenter() + node.boundingVolume->getHalfExtent();
+	bool contained = node.min.x <= node.tightMin.x && node.min.y <= node.tightMin.y && node.min.z <= node.tightMin.z &&
+		node.tightMax.x <= node.max.x && node.tightMax.y <= node.max.y && node.tightMax.z <= node.max.z;
+	if (contained) return true; //still inside the fat box, tree is untouched
+	removeLeaf(leaf);
+	node.min = node.tightMin - glm::vec3(margin);
+	node.max = node.tightMax + glm::vec3(margin);
+	insertLeaf(leaf);
+	return true;
+}
+
+void AABBTree::insertLeaf(uint32_t leaf) {
+	if (root == nullNode) {
+		root = leaf;
+		nodes[root].parent = nullNode;
+		return;
+	}
+	glm::vec3 leafMin = nodes[leaf].min;
+	glm::vec3 leafMax = nodes[leaf].max;
+	//descend while the surface area heuristic says pushing the leaf further down is cheaper
+	//than pairing it with the current node
+	uint32_t index = root;
+	while (!nodes[index].isLeaf()) {
+		const Node& node = nodes[index];
+		float area = surfaceArea(node.min, node.max);
+		float combinedArea = surfaceArea(glm::min(node.min, leafMin), glm::max(node.max, leafMax));
+		float cost = 2.0f * combinedArea;
+		float inheritanceCost = 2.0f * (combinedArea - area);
+		float childCost[2];
+		uint32_t children[2] = { node.child1, node.child2 };
+		for (int i = 0; i < 2; i++) {
+			const Node& child = nodes[children[i]];
+			float unionArea = surfaceArea(glm::min(child.min, leafMin), glm::max(child.max, leafMax));
+			if (child.isLeaf()) childCost[i] = unionArea + inheritanceCost;
+			else childCost[i] = (unionArea - surfaceArea(child.min, child.max)) + inheritanceCost;
+		}
+		if (cost < childCost[0] && cost < childCost[1]) break;
+		index = (childCost[0] < childCost[1]) ? children[0] : children[1];
+	}
+	uint32_t sibling = index;
+	uint32_t newParent = allocateNode(); //may reallocate nodes, don't hold references across this
+	uint32_t oldParent = nodes[sibling].parent;
+	Node& parentNode = nodes[newParent];
+	parentNode.parent = oldParent;
+	parentNode.min = glm::min(leafMin, nodes[sibling].min);
+	parentNode.max = glm::max(leafMax, nodes[sibling].max);
+	parentNode.height = nodes[sibling].height + 1;
+	parentNode.child1 = sibling;
+	parentNode.child2 = leaf;
+	if (oldParent != nullNode) {
+		if (nodes[oldParent].child1 == sibling) nodes[oldParent].child1 = newParent;
+		else nodes[oldParent].child2 = newParent;
+	}
+	else {
+		root = newParent;
+	}
+	nodes[sibling].parent = newParent;
+	nodes[leaf].parent = newParent;
+	refit(nodes[leaf].parent);
+}
+
+void AABBTree::removeLeaf(uint32_t leaf) {
+	if (leaf == root) {
+		root = nullNode;
+		return;
+	}
+	uint32_t parent = nodes[leaf].parent;
+	uint32_t grandParent = nodes[parent].parent;
+	uint32_t sibling = (nodes[parent].child1 == leaf) ? nodes[parent].child2 : nodes[parent].child1;
+	if (grandParent != nullNode) {
+		if (nodes[grandParent].child1 == parent) nodes[grandParent].child1 = sibling;
+		else nodes[grandParent].child2 = sibling;
+		nodes[sibling].parent = grandParent;
+		freeNode(parent);
+		refit(grandParent);
+	}
+	else {
+		root = sibling;
+		nodes[sibling].parent = nullNode;
+		freeNode(parent);
+	}
+	nodes[leaf].parent = nullNode;
+}
+
+void AABBTree::refit(uint32_t index) {
+	//walk back to the root fixing bounds and heights, rotating wherever the subtrees got lopsided
+	while (index != nullNode) {
+		index = balance(index);
+		Node& node = nodes[index];
+		const Node& child1 = nodes[node.child1];
+		const Node& child2 = nodes[node.child2];
+		node.height = 1 + std::max(child1.height, child2.height);
+		node.min = glm::min(child1.min, child2.min);
+		node.max = glm::max(child1.max, child2.max);
+		index = node.parent;
+	}
+}
+
+uint32_t AABBTree::balance(uint32_t iA) {
+	Node& A = nodes[iA];
+	if (A.isLeaf() || A.height < 2) return iA;
+	uint32_t iB = A.child1;
+	uint32_t iC = A.child2;
+	Node& B = nodes[iB];
+	Node& C = nodes[iC];
+	int32_t imbalance = C.height - B.height;
+	if (imbalance > 1) { //rotate C up
+		uint32_t iF = C.child1;
+		uint32_t iG = C.child2;
+		Node& F = nodes[iF];
+		Node& G = nodes[iG];
+		C.child1 = iA;
+		C.parent = A.parent;
+		A.parent = iC;
+		if (C.parent != nullNode) {
+			if (nodes[C.parent].child1 == iA) nodes[C.parent].child1 = iC;
+			else nodes[C.parent].child2 = iC;
+		}
+		else {
+			root = iC;
+		}
+		if (F.height > G.height) {
+			C.child2 = iF;
+			A.child2 = iG;
+			G.parent = iA;
+			A.min = glm::min(B.min, G.min);
+			A.max = glm::max(B.max, G.max);
+			C.min = glm::min(A.min, F.min);
+			C.max = glm::max(A.max, F.max);
+			A.height = 1 + std::max(B.height, G.height);
+			C.height = 1 + std::max(A.height, F.height);
+		}
+		else {
+			C.child2 = iG;
+			A.child2 = iF;
+			F.parent = iA;
+			A.min = glm::min(B.min, F.min);
+			A.max = glm::max(B.max, F.max);
+			C.min = glm::min(A.min, G.min);
+			C.max = glm::max(A.max, G.max);
+			A.height = 1 + std::max(B.height, F.height);
+			C.height = 1 + std::max(A.height, G.height);
+		}
+		return iC;
+	}
+	if (imbalance < -1) { //rotate B up
+		uint32_t iD = B.child1;
+		uint32_t iE = B.child2;
+		Node& D = nodes[iD];
+		Node& E = nodes[iE];
+		B.child1 = iA;
+		B.parent = A.parent;
+		A.parent = iB;
+		if (B.parent != nullNode) {
+			if (nodes[B.parent].child1 == iA) nodes[B.parent].child1 = iB;
+			else nodes[B.parent].child2 = iB;
+		}
+		else {
+			root = iB;
+		}
+		if (D.height > E.height) {
+			B.child2 = iD;
+			A.child1 = iE;
+			E.parent = iA;
+			A.min = glm::min(C.min, E.min);
+			A.max = glm::max(C.max, E.max);
+			B.min = glm::min(A.min, D.min);
+			B.max = glm::max(A.max, D.max);
+			A.height = 1 + std::max(C.height, E.height);
+			B.height = 1 + std::max(A.height, D.height);
+		}
+		else {
+			B.child2 = iE;
+			A.child1 = iD;
+			D.parent = iA;
+			A.min = glm::min(C.min, D.min);
+			A.max = glm::max(C.max, D.max);
+			B.min = glm::min(A.min, E.min);
+			B.max = glm::max(A.max, E.max);
+			A.height = 1 + std::max(C.height, D.height);
+			B.height = 1 + std::max(A.height, E.height);
+		}
+		return iB;
+	}
+	return iA;
+}
+
+template<typename Func>
+void AABBTree::query(const glm::vec3& min, const glm::vec3& max, Func func) const {
+	if (root == nullNode) return;
+	//the tree stays balanced so its height grows with log n, a fixed stack on the call stack keeps queries
+	//free of allocations and safe to run from several threads
+	uint32_t stack[maxStackSize];
+	int top = 0;
+	stack[top++] = root;
+	while (top > 0) {
+		uint32_t index = stack[--top];
+		const Node& node = nodes[index];
+		if (!overlap(node.min, node.max, min, max)) continue;
+		if (node.isLeaf()) {
+			if (overlap(node.tightMin, node.tightMax, min, max)) func(index, node);
+		}
+		else {
+			assert(top + 2 <= maxStackSize);
+			stack[top++] = node.child1;
+			stack[top++] = node.child2;
+		}
+	}
+}
+
+void AABBTree::queryRegion(const glm::vec3& min, const glm::vec3& max, std::vector<BoundingVolumePair>& out) const {
+	query(min, max, [&out](uint32_t, const Node& node) {
+		out.push_back(BoundingVolumePair{ node.index, node.boundingVolume });
+	});
+}
+
+void AABBTree::queryRay(const glm::vec3& origin, const glm::vec3& direction, float maxDistance, std::vector<BoundingVolumePair>& out) const {
+	if (root == nullNode) return;
+	glm::vec3 invDirection = 1.0f / direction;
+	uint32_t stack[maxStackSize];
+	int top = 0;
+	stack[top++] = root;
+	while (top > 0) {
+		const Node& node = nodes[stack[--top]];
+		if (!rayBox(origin, invDirection, maxDistance, node.min, node.max)) continue;
+		if (node.isLeaf()) {
+			if (rayBox(origin, invDirection, maxDistance, node.tightMin, node.tightMax)) out.push_back(BoundingVolumePair{ node.index, node.boundingVolume });
+		}
+		else {
+			assert(top + 2 <= maxStackSize);
+			stack[top++] = node.child1;
+			stack[top++] = node.child2;
+		}
+	}
+}
+
+void AABBTree::getNearestObjects(ProxyHandle proxy, std::vector<BoundingVolumePair>& out) const {
+	if (proxy >= nodes.size() || nodes[proxy].height != 0) return;
+	const Node& leaf = nodes[proxy];
+	query(leaf.tightMin, leaf.tightMax, [&out, proxy](uint32_t index, const Node& node) {
+		if (index != proxy) out.push_back(BoundingVolumePair{ node.index, node.boundingVolume });
+	});
+}
+
+void AABBTree::queryFrustum(const Frustum& frustum, std::vector<BoundingVolumePair>& out) const {
+	if (root == nullNode) return;
+	//below a node wholly inside every leaf is visible, those subtrees are walked without testing
+	uint32_t stack[maxStackSize];
+	bool insideStack[maxStackSize];
+	int top = 0;
+	stack[top] = root;
+	insideStack[top++] = false;
+	while (top > 0) {
+		top--;
+		const Node& node = nodes[stack[top]];
+		bool inside = insideStack[top];
+		if (!inside) {
+			Frustum::Result result = frustum.test(node.min, node.max);
+			if (result == Frustum::Result::Outside) continue;
+			inside = result == Frustum::Result::Inside;
+		}
+		if (node.isLeaf()) {
+			if (inside || frustum.test(node.tightMin, node.tightMax) != Frustum::Result::Outside) out.push_back(BoundingVolumePair{ node.index, node.boundingVolume });
+		}
+		else {
+			assert(top + 2 <= maxStackSize);
+			stack[top] = node.child1;
+			insideStack[top++] = inside;
+			stack[top] = node.child2;
+			insideStack[top++] = inside;
+		}
+	}
+}
+
+bool AABBTree::rayCast(const Ray& ray, RayHit& hit, bool anyHit) const {
+	castPacket(&ray, &hit, 1, anyHit);
+	return hit.index != UINT32_MAX;
+}
+
+void AABBTree::rayCastRange(const Ray* rays, RayHit* hits, size_t count, bool anyHit) const {
+	for (size_t first = 0; first < count; first += rayPacketSize) {
+		castPacket(rays + first, hits + first, static_cast<uint32_t>(std::min<size_t>(rayPacketSize, count - first)), anyHit);
+	}
+}
+
+void AABBTree::castPacket(const Ray* rays, RayHit* hits, uint32_t count, bool anyHit) const {
+	assert(count > 0 && count <= 32);
+	for (uint32_t i = 0; i < count; i++) hits[i] = RayHit{};
+	if (root == nullNode) return;
+	//each stack entry carries the mask of rays that reached its parent, rays leave active once anyHit has their answer
+	uint32_t active = count == 32 ? UINT32_MAX : (1u << count) - 1;
+	uint32_t stack[maxStackSize];
+	uint32_t masks[maxStackSize];
+	int top = 0;
+	stack[top] = root;
+	masks[top++] = active;
+	const Ray& lead = rays[0];
+	while (top > 0) {
+		top--;
+		const Node& node = nodes[stack[top]];
+		uint32_t mask = masks[top] & active;
+		uint32_t reached = 0;
+		float enter;
+		for (uint32_t i = 0; i < count; i++) {
+			if ((mask & (1u << i)) && rays[i].clip(node.min, node.max, std::min(hits[i].distance, rays[i].maxDistance), enter)) reached |= 1u << i;
+		}
+		if (reached == 0) continue;
+		if (node.isLeaf()) {
+			for (uint32_t i = 0; i < count; i++) {
+				if (!(reached & (1u << i)) || !rays[i].clip(node.tightMin, node.tightMax, std::min(hits[i].distance, rays[i].maxDistance), enter)) continue;
+				if (closerHit(rays[i], node.index, node.boundingVolume, hits[i]) && anyHit) active &= ~(1u << i);
+			}
+			if (active == 0) return;
+			continue;
+		}
+		//the child nearer along the first ray goes on top, early close hits shrink what the rest has to look at
+		const Node& child1 = nodes[node.child1];
+		const Node& child2 = nodes[node.child2];
+		bool firstNearer = glm::dot(child1.min + child1.max, lead.direction) <= glm::dot(child2.min + child2.max, lead.direction);
+		assert(top + 2 <= maxStackSize);
+		stack[top] = firstNearer ? node.child2 : node.child1;
+		masks[top++] = reached;
+		stack[top] = firstNearer ? node.child1 : node.child2;
+		masks[top++] = reached;
+	}
+}
+
+void AABBTree::getCollisionPairs(std::vector<CollisionPair>& out) const {
+	collectPairs(0, static_cast<uint32_t>(nodes.size()), out);
+}
+
+void AABBTree::getCollisionPairs(std::vector<CollisionPair>& out, JobSystem& jobs, WorkerPairs& workerPairs) const {
+	clearWorkerPairs(jobs, workerPairs);
+	jobs.parallelFor(static_cast<uint32_t>(nodes.size()), 512, [this, &workerPairs](uint32_t begin, uint32_t end, uint32_t worker) {
+		collectPairs(begin, end, workerPairs[worker]);
+	});
+	mergeWorkerPairs(out, jobs, workerPairs);
+}
+
+void AABBTree::collectPairs(uint32_t begin, uint32_t end, std::vector<CollisionPair>& out) const {
+	for (uint32_t leaf = begin; leaf < end; leaf++) {
+		const Node& leafNode = nodes[leaf];
+		if (leafNode.height != 0) continue; //internal or free
+		query(leafNode.tightMin, leafNode.tightMax, [&out, leaf, &leafNode](uint32_t index, const Node& node) {
+			//every pair is seen from both leaves, keep the one found from the lower node id
+			if (index <= leaf) return;
+			out.push_back(CollisionPair{ BoundingVolumePair{ leafNode.index, leafNode.boundingVolume }, BoundingVolumePair{ node.index, node.boundingVolume } });
+		});
+	}
+}
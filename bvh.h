@@ -0,0 +1,56 @@
+#pragma once
+#include "scene.h"
+
+//dynamic bounding volume tree in the style of Box2D's b2DynamicTree, leaves store enlarged ("fat")
+//boxes so an entity only gets reinserted once it leaves its fat box. handles are leaf node ids, rotations
+//only ever move internal nodes so a leaf keeps its id for as long as it lives
+class AABBTree : public SpatialPartition {
+public:
+	AABBTree(float margin = aabbTreeMargin) : margin{ margin } {}
+	void getNearestObjects(ProxyHandle proxy, std::vector<BoundingVolumePair>& out) const override;
+	void queryFrustum(const Frustum& frustum, std::vector<BoundingVolumePair>& out) const override;
+	bool rayCast(const Ray& ray, RayHit& hit, bool anyHit = false) const override;
+	ProxyHandle insert(uint32_t entityIndex, BoundingVolume* boundingVolume) override;
+	bool remove(ProxyHandle proxy) override;
+	bool update(ProxyHandle proxy) override;
+	void getCollisionPairs(std::vector<CollisionPair>& out) const override;
+	void getCollisionPairs(std::vector<CollisionPair>& out, JobSystem& jobs, WorkerPairs& workerPairs) const override;
+	//everything whose box overlaps [min, max]
+	void queryRegion(const glm::vec3& min, const glm::vec3& max, std::vector<BoundingVolumePair>& out) const;
+	//everything whose box the ray passes through before maxDistance, direction doesn't need to be normalized
+	//but maxDistance is measured in multiples of it
+	void queryRay(const glm::vec3& origin, const glm::vec3& direction, float maxDistance, std::vector<BoundingVolumePair>& out) const;
+	int32_t getHeight() const { return root == nullNode ? 0 : nodes[root].height; }
+private:
+	static constexpr uint32_t nullNode = UINT32_MAX;
+	static constexpr int maxStackSize = 256;
+	struct Node {
+		glm::vec3 min{ 0.0f }; //fat bounds for leaves
+		glm::vec3 max{ 0.0f };
+		glm::vec3 tightMin{ 0.0f }; //leaves only
+		glm::vec3 tightMax{ 0.0f };
+		uint32_t parent = nullNode; //doubles as the free list link
+		uint32_t child1 = nullNode;
+		uint32_t child2 = nullNode;
+		int32_t height = -1; //0 for leaves, -1 for free nodes
+		uint32_t index = UINT32_MAX;
+		BoundingVolume* boundingVolume = nullptr;
+		bool isLeaf() const { return child1 == nullNode; }
+	};
+	float margin;
+	std::vector<Node> nodes;
+	uint32_t root = nullNode;
+	uint32_t freeList = nullNode;
+	uint32_t allocateNode();
+	void freeNode(uint32_t node);
+	void insertLeaf(uint32_t leaf);
+	void removeLeaf(uint32_t leaf);
+	uint32_t balance(uint32_t iA);
+	void refit(uint32_t node);
+	template<typename Func>
+	void query(const glm::vec3& min, const glm::vec3& max, Func func) const;
+	void rayCastRange(const Ray* rays, RayHit* hits, size_t count, bool anyHit) const override;
+	//up to 32 rays down the tree together, a node is loaded once for every ray that reaches it
+	void castPacket(const Ray* rays, RayHit* hits, uint32_t count, bool anyHit) const;
+	void collectPairs(uint32_t begin, uint32_t end, std::vector<CollisionPair>& out) const; //pairs found from leaves in nodes [begin, end)
+};
@@ -28,3 +28,148 @@ bool boxSphereIntersection(const AABB& aabb, const BoundingSphere& boundingSpher
 	float d = glm::dot(e, e);
 	return d <= boundingSphere.radius * boundingSphere.radius;
 }
+
+bool boxContact(const AABB& first, const AABB& second, ContactManifold& manifold) {
+	glm::vec3 first_min = first.center - first.halfExtent;
+	glm::vec3 first_max = first.center + first.halfExtent;
+	glm::vec3 second_min = second.center - second.halfExtent;
+	glm::vec3 second_max = second.center + second.halfExtent;
+	if (first_min.x > second_max.x || second_min.x > first_max.x) return false;
+	if (first_min.y > second_max.y || second_min.y > first_max.y) return false;
+	if (first_min.z > second_max.z || second_min.z > first_max.z) return false;
+	//the shortest of the six pushes that take the second box clear, and the faces touching across it meet in
+	//the rectangle the overlap box has on that axis
+	glm::vec3 forward = first_max - second_min;
+	glm::vec3 backward = second_max - first_min;
+	int axis = 0;
+	float sign = 1.0f;
+	manifold.depth = FLT_MAX;
+	for (int i = 0; i < 3; i++) {
+		if (forward[i] < manifold.depth) {
+			manifold.depth = forward[i];
+			axis = i;
+			sign = 1.0f;
+		}
+		if (backward[i] < manifold.depth) {
+			manifold.depth = backward[i];
+			axis = i;
+			sign = -1.0f;
+		}
+	}
+	manifold.normal = glm::vec3(0.0f);
+	manifold.normal[axis] = sign;
+	glm::vec3 overlap_min = glm::max(first_min, second_min);
+	glm::vec3 overlap_max = glm::min(first_max, second_max);
+	int u = (axis + 1) % 3;
+	int v = (axis + 2) % 3;
+	for (uint32_t i = 0; i < 4; i++) {
+		glm::vec3& point = manifold.points[i];
+		point[axis] = (overlap_min[axis] + overlap_max[axis]) * 0.5f;
+		point[u] = (i & 1) ? overlap_max[u] : overlap_min[u];
+		point[v] = (i & 2) ? overlap_max[v] : overlap_min[v];
+	}
+	manifold.pointCount = 4;
+	return true;
+}
+
+bool sphereContact(const BoundingSphere& first, const BoundingSphere& second, ContactManifold& manifold) {
+	glm::vec3 d = second.center - first.center;
+	float dist_sq = glm::dot(d, d);
+	float radiusSum = first.radius + second.radius;
+	if (dist_sq > radiusSum * radiusSum) return false;
+	float dist = std::sqrt(dist_sq);
+	//concentric spheres have no direction to separate in, any will do
+	manifold.normal = dist > 0.0f ? d / dist : glm::vec3(0.0f, 1.0f, 0.0f);
+	manifold.depth = radiusSum - dist;
+	manifold.points[0] = first.center + manifold.normal * (first.radius - manifold.depth * 0.5f);
+	manifold.pointCount = 1;
+	return true;
+}
+
+bool boxSphereContact(const AABB& aabb, const BoundingSphere& boundingSphere, ContactManifold& manifold) {
+	glm::vec3 aabb_min = aabb.center - aabb.halfExtent;
+	glm::vec3 aabb_max = aabb.center + aabb.halfExtent;
+	glm::vec3 e = glm::max(aabb_min - boundingSphere.center, glm::vec3(0.0f));
+	e += glm::max(boundingSphere.center - aabb_max, glm::vec3(0.0f));
+	float d = glm::dot(e, e);
+	if (d > boundingSphere.radius * boundingSphere.radius) return false;
+	glm::vec3 closest = glm::clamp(boundingSphere.center, aabb_min, aabb_max);
+	if (d > 0.0f) {
+		float dist = std::sqrt(d);
+		manifold.normal = (boundingSphere.center - closest) / dist;
+		manifold.depth = boundingSphere.radius - dist;
+		manifold.points[0] = closest + manifold.normal * (manifold.depth * -0.5f);
+	}
+	else {
+		//center inside the box, pushed out through the nearest face
+		glm::vec3 below = boundingSphere.center - aabb_min;
+		glm::vec3 above = aabb_max - boundingSphere.center;
+		int axis = 0;
+		float faceDistance = FLT_MAX;
+		float sign = 1.0f;
+		for (int i = 0; i < 3; i++) {
+			if (below[i] < faceDistance) {
+				faceDistance = below[i];
+				axis = i;
+				sign = -1.0f;
+			}
+			if (above[i] < faceDistance) {
+				faceDistance = above[i];
+				axis = i;
+				sign = 1.0f;
+			}
+		}
+		manifold.normal = glm::vec3(0.0f);
+		manifold.normal[axis] = sign;
+		manifold.depth = boundingSphere.radius + faceDistance;
+		manifold.points[0] = boundingSphere.center;
+		manifold.points[0][axis] += sign * (faceDistance - manifold.depth * 0.5f);
+	}
+	manifold.pointCount = 1;
+	return true;
+}
+
+bool rayBoxIntersection(const Ray& ray, const AABB& aabb, float& distance) {
+	return ray.clip(aabb.center - aabb.halfExtent, aabb.center + aabb.halfExtent, ray.maxDistance, distance);
+}
+
+bool raySphereIntersection(const Ray& ray, const BoundingSphere& boundingSphere, float& distance) {
+	//|m + t d|^2 = r^2 with m from the center to the origin, solved for the smaller t
+	glm::vec3 m = ray.origin - boundingSphere.center;
+	float c = glm::dot(m, m) - boundingSphere.radius * boundingSphere.radius;
+	if (c <= 0.0f) {
+		distance = 0.0f;
+		return true;
+	}
+	float b = glm::dot(m, ray.direction);
+	if (b >= 0.0f) return false; //outside and pointing away
+	float a = glm::dot(ray.direction, ray.direction);
+	float discriminant = b * b - a * c;
+	if (discriminant < 0.0f) return false;
+	distance = (-b - std::sqrt(discriminant)) / a;
+	return distance <= ray.maxDistance;
+}
+
+Frustum::Frustum(const glm::mat4& viewProjection) {
+	//glm is column major, row i is (m[0][i], m[1][i], m[2][i], m[3][i])
+	for (int i = 0; i < 3; i++) {
+		for (int j = 0; j < 4; j++) {
+			planes[2 * i][j] = viewProjection[j][3] + viewProjection[j][i];
+			planes[2 * i + 1][j] = viewProjection[j][3] - viewProjection[j][i];
+		}
+	}
+	for (glm::vec4& plane : planes) plane /= glm::length(glm::vec3(plane));
+}
+
+Frustum::Result Frustum::test(const glm::vec3& min, const glm::vec3& max) const {
+	Result result = Result::Inside;
+	for (const glm::vec4& plane : planes) {
+		glm::vec3 normal(plane);
+		//the corners furthest along and against the normal
+		glm::vec3 positive(normal.x >= 0.0f ? max.x : min.x, normal.y >= 0.0f ? max.y : min.y, normal.z >= 0.0f ? max.z : min.z);
+		glm::vec3 negative(normal.x >= 0.0f ? min.x : max.x, normal.y >= 0.0f ? min.y : max.y, normal.z >= 0.0f ? min.z : max.z);
+		if (glm::dot(normal, positive) + plane.w < 0.0f) return Result::Outside;
+		if (glm::dot(normal, negative) + plane.w < 0.0f) result = Result::Intersecting;
+	}
+	return result;
+}
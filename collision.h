@@ -5,9 +5,16 @@
 #include <glm/gtc/type_ptr.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include <vector>
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cassert>
+#include <cstdlib>
+#include <cstdint>
+#include <type_traits>
 
 enum class BoundType {None, AABB, Sphere};
-class AABB; class BoundingSphere;
+struct AABB; struct BoundingSphere;
 
 
 bool boxIntersection(const AABB& first, const AABB& second);
@@ -16,59 +23,186 @@ bool sphereIntersection(const BoundingSphere& first, const BoundingSphere& secon
 
 bool boxSphereIntersection(const AABB& aabb, const BoundingSphere& boundingSphere);
 
-class BoundingVolume {
-public:
-	virtual ~BoundingVolume(){}
-	virtual BoundType getType() = 0;
-	virtual bool intersect(BoundingVolume* boundingVolume) = 0;
-	virtual bool intersect(const AABB& aabb) = 0;
-	virtual bool intersect(const BoundingSphere& boundingSphere) = 0;
-	virtual glm::vec3 getHalfExtent() = 0;
-	virtual glm::vec3 getCenter() = 0;
+//where two shapes touch. the normal is a unit vector pointing from the first shape to the second, depth is how
+//far they overlap along it, and the points lie halfway through the overlap. plain data so a solver can take
+//a whole buffer of them, pointCount is 0 for pairs that don't touch
+struct ContactManifold {
+	static constexpr uint32_t maxPoints = 4;
+	glm::vec3 normal{ 0.0f };
+	float depth = 0.0f;
+	glm::vec3 points[maxPoints];
+	uint32_t pointCount = 0;
 };
 
-class AABB : public BoundingVolume { //meant for static geometry
-public:
-	AABB() : center{ 0.0f }, halfExtent{ 0.0f } {}
-	BoundType getType() override { return BoundType::AABB; }
-	bool intersect(BoundingVolume* boundingVolume) override {
-		return boundingVolume->intersect(*this);
-	}
-	bool intersect(const AABB& aabb) override {
-		return boxIntersection(*this, aabb);
-	}
-	bool intersect(const BoundingSphere& boundingSphere) override {
-		return boxSphereIntersection(*this, boundingSphere);
-	}
-	glm::vec3 getHalfExtent() override {
-		return halfExtent;
-	}
-	glm::vec3 getCenter() override {
-		return center;
-	}
-	glm::vec3 center;
-	glm::vec3 halfExtent;
+//same overlap rules as the tests above, manifold is only written when they return true
+bool boxContact(const AABB& first, const AABB& second, ContactManifold& manifold);
+
+bool sphereContact(const BoundingSphere& first, const BoundingSphere& second, ContactManifold& manifold);
+
+bool boxSphereContact(const AABB& aabb, const BoundingSphere& boundingSphere, ContactManifold& manifold);
+
+//the six clip planes of a view projection matrix (Gribb/Hartmann), normals pointing inwards
+struct Frustum {
+	enum class Result { Outside, Intersecting, Inside };
+	Frustum() {}
+	explicit Frustum(const glm::mat4& viewProjection);
+	Result test(const glm::vec3& min, const glm::vec3& max) const; //conservative, a box near a corner may come back Intersecting
+	glm::vec4 planes[6];
 };
 
-class BoundingSphere : public BoundingVolume {
-public:
-	BoundingSphere() : center{ 0.0f }, radius{ 0.0f } {}
-	BoundType getType() override { return BoundType::Sphere; }
-	glm::vec3 center;
-	float radius;
-	bool intersect(BoundingVolume* boundingVolume) override {
-		return boundingVolume->intersect(*this);
-	}
-	bool intersect(const AABB& aabb) override {
-		return boxSphereIntersection(aabb, *this);
+//hits count up to maxDistance, measured in multiples of direction so it doesn't need to be normalized.
+//the reciprocal direction is kept for slab tests, so set the ray up through the constructor
+struct Ray {
+	Ray() {}
+	Ray(const glm::vec3& origin, const glm::vec3& direction, float maxDistance = FLT_MAX) : origin{ origin }, direction{ direction }, maxDistance{ maxDistance } {
+		//zero components get a huge but finite reciprocal, so a ray along a slab face never turns into 0 * inf
+		for (int i = 0; i < 3; i++) invDirection[i] = 1.0f / (std::abs(direction[i]) > 1e-30f ? direction[i] : std::copysign(1e-30f, direction[i]));
 	}
-	bool intersect(const BoundingSphere& boundingSphere) override {
-		return sphereIntersection(*this, boundingSphere);
+	//where the ray enters [min, max], 0 from inside. false if it misses or gets there only past limit
+	bool clip(const glm::vec3& min, const glm::vec3& max, float limit, float& enter) const {
+		glm::vec3 t1 = (min - origin) * invDirection;
+		glm::vec3 t2 = (max - origin) * invDirection;
+		glm::vec3 tmin = glm::min(t1, t2);
+		glm::vec3 tmax = glm::max(t1, t2);
+		enter = std::max(std::max(tmin.x, tmin.y), std::max(tmin.z, 0.0f));
+		float exit = std::min(std::min(tmax.x, tmax.y), std::min(tmax.z, limit));
+		return enter <= exit;
 	}
-	glm::vec3 getHalfExtent() override {
-		return glm::vec3(radius);
+	glm::vec3 origin{ 0.0f };
+	glm::vec3 direction{ 0.0f, 0.0f, -1.0f };
+	glm::vec3 invDirection{ 0.0f, 0.0f, -1.0f };
+	float maxDistance = FLT_MAX;
+};
+
+//exact ray tests, distance is where the ray enters the volume (0 if it starts inside)
+bool rayBoxIntersection(const Ray& ray, const AABB& aabb, float& distance);
+
+bool raySphereIntersection(const Ray& ray, const BoundingSphere& boundingSphere, float& distance);
+
+//shapes are standalone plain records, no vtable and no base class. each opens with a BoundingVolume header
+//holding its BoundType tag, and as both are standard layout a pointer to the header is a pointer to the record,
+//which is what partitions and pairs pass around. the tag picks the record type through ShapeOf, and pairs are
+//tested by the PairTest entry for the two record types, so both the single pair switch below and loops already
+//sorted by shape (see Narrowphase) inline the test. a new shape needs its record starting with the header, a
+//ShapeOf entry, a case in visitShape and PairTest entries against the shapes before it
+struct BoundingVolume {
+	BoundType getType() const { return type; }
+	inline bool intersect(const BoundingVolume& boundingVolume) const;
+	inline bool contact(const BoundingVolume& boundingVolume, ContactManifold& manifold) const;
+	bool intersect(const BoundingVolume* boundingVolume) const { return intersect(*boundingVolume); }
+	inline bool intersect(const Ray& ray, float& distance) const;
+	inline glm::vec3 getHalfExtent() const;
+	inline glm::vec3 getCenter() const;
+	BoundType type;
+};
+
+struct AABB { //meant for static geometry
+	static constexpr BoundType boundType = BoundType::AABB;
+	BoundingVolume volume{ boundType };
+	glm::vec3 center{ 0.0f };
+	glm::vec3 halfExtent{ 0.0f };
+	glm::vec3 getCenter() const { return center; }
+	glm::vec3 getHalfExtent() const { return halfExtent; }
+};
+
+struct BoundingSphere {
+	static constexpr BoundType boundType = BoundType::Sphere;
+	BoundingVolume volume{ boundType };
+	glm::vec3 center{ 0.0f };
+	float radius = 0.0f;
+	glm::vec3 getCenter() const { return center; }
+	glm::vec3 getHalfExtent() const { return glm::vec3(radius); }
+};
+
+static_assert(std::is_standard_layout<AABB>::value && std::is_trivially_copyable<AABB>::value, "shapes are plain data reached through their header");
+static_assert(std::is_standard_layout<BoundingSphere>::value && std::is_trivially_copyable<BoundingSphere>::value, "shapes are plain data reached through their header");
+
+template<BoundType Type> struct ShapeOf;
+template<> struct ShapeOf<BoundType::AABB> { using type = AABB; };
+template<> struct ShapeOf<BoundType::Sphere> { using type = BoundingSphere; };
+
+//the record a header belongs to, the tag has to match
+template<typename Shape>
+inline const Shape& shapeCast(const BoundingVolume& boundingVolume) {
+	assert(boundingVolume.type == Shape::boundType);
+	return *reinterpret_cast<const Shape*>(&boundingVolume);
+}
+
+template<typename Shape>
+inline Shape& shapeCast(BoundingVolume& boundingVolume) {
+	assert(boundingVolume.type == Shape::boundType);
+	return *reinterpret_cast<Shape*>(&boundingVolume);
+}
+
+//calls func with the record behind the tag, a tag without a record is a corrupt header and stops the program
+template<typename Func>
+inline decltype(auto) visitShape(const BoundingVolume& boundingVolume, Func&& func) {
+	switch (boundingVolume.type) {
+	case BoundType::AABB: return func(shapeCast<ShapeOf<BoundType::AABB>::type>(boundingVolume));
+	case BoundType::Sphere: return func(shapeCast<ShapeOf<BoundType::Sphere>::type>(boundingVolume));
+	default: break;
 	}
-	glm::vec3 getCenter() override {
-		return center;
+	assert(!"visitShape: unknown BoundType");
+	std::abort();
+}
+
+//the pair table, one entry per unordered combination. the mirrored ones swap their arguments
+template<typename First, typename Second>
+struct PairTest {
+	static bool intersect(const First& first, const Second& second) { return PairTest<Second, First>::intersect(second, first); }
+	static bool contact(const First& first, const Second& second, ContactManifold& manifold) {
+		if (!PairTest<Second, First>::contact(second, first, manifold)) return false;
+		manifold.normal = -manifold.normal;
+		return true;
 	}
-};
\ No newline at end of file
+};
+template<> struct PairTest<AABB, AABB> {
+	static bool intersect(const AABB& first, const AABB& second) { return boxIntersection(first, second); }
+	static bool contact(const AABB& first, const AABB& second, ContactManifold& manifold) { return boxContact(first, second, manifold); }
+};
+template<> struct PairTest<BoundingSphere, BoundingSphere> {
+	static bool intersect(const BoundingSphere& first, const BoundingSphere& second) { return sphereIntersection(first, second); }
+	static bool contact(const BoundingSphere& first, const BoundingSphere& second, ContactManifold& manifold) { return sphereContact(first, second, manifold); }
+};
+template<> struct PairTest<AABB, BoundingSphere> {
+	static bool intersect(const AABB& aabb, const BoundingSphere& boundingSphere) { return boxSphereIntersection(aabb, boundingSphere); }
+	static bool contact(const AABB& aabb, const BoundingSphere& boundingSphere, ContactManifold& manifold) { return boxSphereContact(aabb, boundingSphere, manifold); }
+};
+
+template<typename Shape> struct RayTest;
+template<> struct RayTest<AABB> {
+	static bool intersect(const Ray& ray, const AABB& aabb, float& distance) { return rayBoxIntersection(ray, aabb, distance); }
+};
+template<> struct RayTest<BoundingSphere> {
+	static bool intersect(const Ray& ray, const BoundingSphere& boundingSphere, float& distance) { return raySphereIntersection(ray, boundingSphere, distance); }
+};
+
+bool BoundingVolume::intersect(const BoundingVolume& boundingVolume) const {
+	return visitShape(*this, [&boundingVolume](const auto& first) {
+		return visitShape(boundingVolume, [&first](const auto& second) {
+			return PairTest<std::decay_t<decltype(first)>, std::decay_t<decltype(second)>>::intersect(first, second);
+		});
+	});
+}
+
+bool BoundingVolume::contact(const BoundingVolume& boundingVolume, ContactManifold& manifold) const {
+	return visitShape(*this, [&boundingVolume, &manifold](const auto& first) {
+		return visitShape(boundingVolume, [&first, &manifold](const auto& second) {
+			return PairTest<std::decay_t<decltype(first)>, std::decay_t<decltype(second)>>::contact(first, second, manifold);
+		});
+	});
+}
+
+bool BoundingVolume::intersect(const Ray& ray, float& distance) const {
+	return visitShape(*this, [&ray, &distance](const auto& shape) {
+		return RayTest<std::decay_t<decltype(shape)>>::intersect(ray, shape, distance);
+	});
+}
+
+glm::vec3 BoundingVolume::getHalfExtent() const {
+	return visitShape(*this, [](const auto& shape) { return shape.getHalfExtent(); });
+}
+
+glm::vec3 BoundingVolume::getCenter() const {
+	return visitShape(*this, [](const auto& shape) { return shape.getCenter(); });
+}
@@ -10,6 +10,13 @@ const bool useDebugContext = false;
 const bool useDebugContext = true;
 #endif // NDEBUG
 
+//SSE2 is part of x64 and the default for 32 bit MSVC, anything else takes the scalar paths
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define HAS_SSE2 1
+#else
+#define HAS_SSE2 0
+#endif
+
 class Camera;
 class Renderer;
 struct UIState;
@@ -32,5 +39,19 @@ const double mouseSensitivity = 0.8f;
 const double mouseSmoothingFactor = 0.5;
 const uint32_t maxInstances = 1000; //80 MB size storage buffer
 const uint32_t maxEntities = 1000;
+const float gridCellSize = 2.0f; //SpatialHashGrid default, roughly the diameter of a typical sphere
+const float hgridMinCellSize = 1.0f; //HierarchicalGrid finest cell width, every level up doubles it
+const float octreeWorldSize = 1024.0f; //LooseOctree root cell width, centered on the origin
+const uint32_t octreeMaxDepth = 10; //finest LooseOctree cells are octreeWorldSize / 2^depth wide
+const float mbpRegionSize = 64.0f; //MultiBoxPruning region width, far larger than most entities so few end up on a border
+const float aabbTreeMargin = 0.2f; //how far AABBTree leaves are fattened so small moves don't reinsert
+const uint32_t rayPacketSize = 16; //rays the trees trace together in batched ray casts, at most 32
+const uint32_t sweepAxisInterval = 64; //how many sorts SortedAABBArray keeps its sweep axis before checking the spread again
+const float gravity = -9.81f; //along y, applied to every rigid body that isn't kinematic
+const uint32_t solverIterations = 8; //contact solver passes per step
+const float contactSlop = 0.01f; //penetration left alone so resting contacts don't jitter
+const float contactBaumgarte = 0.2f; //fraction of the remaining penetration pushed out per step
+const float restitutionThreshold = 0.5f; //approach speeds below this don't bounce, resting contacts would otherwise hop
+const uint32_t broadphaseVerifyInterval = 0; //check the broadphase pairs against NullPartition every n frames, 0 turns it off
 
 constexpr const char* GLSL_VERSION_STRING = "#version 430 core";
@@ -0,0 +1,438 @@
+#include "grid.h"
+#include "jobs.h"
+#include <algorithm>
+
+CellTable::Cell& CellTable::insert(const glm::ivec3& coord) {
+	if (2 * (numUsed + 1) > cells.size()) grow();
+	size_t mask = cells.size() - 1;
+	for (size_t i = hash(coord) & mask;; i = (i + 1) & mask) {
+		Cell& cell = cells[i];
+		if (!cell.used) {
+			cell.used = true;
+			cell.coord = coord;
+			numUsed++;
+			return cell;
+		}
+		if (cell.coord == coord) return cell;
+	}
+}
+
+const CellTable::Cell* CellTable::find(const glm::ivec3& coord) const {
+	size_t mask = cells.size() - 1;
+	for (size_t i = hash(coord) & mask;; i = (i + 1) & mask) {
+		const Cell& cell = cells[i];
+		if (!cell.used) return nullptr;
+		if (cell.coord == coord) return &cell;
+	}
+}
+
+CellTable::Cell* CellTable::find(const glm::ivec3& coord) {
+	return const_cast<Cell*>(static_cast<const CellTable*>(this)->find(coord));
+}
+
+void CellTable::clear() {
+	for (Cell& cell : cells) {
+		cell.used = false;
+		cell.proxies.clear();
+	}
+	numUsed = 0;
+}
+
+void CellTable::grow() {
+	size_t occupied = 0;
+	for (Cell& cell : cells) {
+		if (cell.used && !cell.proxies.empty()) occupied++;
+	}
+	size_t capacity = cells.size();
+	while (4 * (occupied + 1) > capacity) capacity *= 2; //leave room so we don't grow again right away
+	std::vector<Cell> old(capacity);
+	std::swap(old, cells);
+	numUsed = 0;
+	size_t mask = cells.size() - 1;
+	for (Cell& cell : old) {
+		if (!cell.used || cell.proxies.empty()) continue;
+		size_t i = hash(cell.coord) & mask;
+		while (cells[i].used) i = (i + 1) & mask;
+		cells[i] = std::move(cell);
+		numUsed++;
+	}
+}
+
+ProxyHandle SpatialHashGrid::insert(uint32_t entityIndex, BoundingVolume* boundingVolume) {
+	assert(boundingVolume);
+	uint32_t slot;
+	if (!freeProxies.empty()) {
+		slot = freeProxies.back();
+		freeProxies.pop_back();
+	}
+	else {
+		slot = static_cast<uint32_t>(proxies.size());
+		proxies.emplace_back();
+	}
+	Proxy& proxy = proxies[slot];
+	proxy.index = entityIndex;
+	proxy.boundingVolume = boundingVolume;
+	proxy.min = boundingVolume->getCenter() - boundingVolume->getHalfExtent();
+	proxy.max = boundingVolume->getCenter() + boundingVolume->getHalfExtent();
+	proxy.cellMin = toCell(proxy.min);
+	proxy.cellMax = toCell(proxy.max);
+	addToCells(slot);
+	return slot;
+}
+
+bool SpatialHashGrid::remove(ProxyHandle proxy) {
+	if (proxy >= proxies.size() || proxies[proxy].index == UINT32_MAX) return false;
+	removeFromCells(proxy);
+	proxies[proxy].index = UINT32_MAX;
+	proxies[proxy].boundingVolume = nullptr;
+	freeProxies.push_back(proxy);
+	return true;
+}
+
+bool SpatialHashGrid::update(ProxyHandle proxy) {
+	if (proxy >= proxies.size() || proxies[proxy].index == UINT32_MAX) return false;
+	Proxy& moved = proxies[proxy];
+	moved.min = moved.boundingVolume->getCenter() - moved.boundingVolume->getHalfExtent();
+	moved.max = moved.boundingVolume->getCenter() + moved.boundingVolume->getHalfExtent();
+	glm::ivec3 cellMin = toCell(moved.min);
+	glm::ivec3 cellMax = toCell(moved.max);
+	if (cellMin == moved.cellMin && cellMax == moved.cellMax) return true; //common case, still in the same cells
+	removeFromCells(proxy);
+	moved.cellMin = cellMin;
+	moved.cellMax = cellMax;
+	addToCells(proxy);
+	return true;
+}
+
+void SpatialHashGrid::addToCells(uint32_t slot) {
+	glm::ivec3 cellMin = proxies[slot].cellMin;
+	glm::ivec3 cellMax = proxies[slot].cellMax;
+	for (int x = cellMin.x; x <= cellMax.x; x++) {
+		for (int y = cellMin.y; y <= cellMax.y; y++) {
+			for (int z = cellMin.z; z <= cellMax.z; z++) {
+				cells.insert(glm::ivec3(x, y, z)).proxies.push_back(slot);
+			}
+		}
+	}
+}
+
+void SpatialHashGrid::removeFromCells(uint32_t slot) {
+	glm::ivec3 cellMin = proxies[slot].cellMin;
+	glm::ivec3 cellMax = proxies[slot].cellMax;
+	for (int x = cellMin.x; x <= cellMax.x; x++) {
+		for (int y = cellMin.y; y <= cellMax.y; y++) {
+			for (int z = cellMin.z; z <= cellMax.z; z++) {
+				CellTable::Cell* cell = cells.find(glm::ivec3(x, y, z));
+				assert(cell);
+				std::vector<uint32_t>& cellProxies = cell->proxies;
+				auto it = std::find(cellProxies.begin(), cellProxies.end(), slot);
+				assert(it != cellProxies.end());
+				*it = cellProxies.back();
+				cellProxies.pop_back();
+			}
+		}
+	}
+}
+
+void SpatialHashGrid::getNearestObjects(ProxyHandle proxy, std::vector<BoundingVolumePair>& out) const {
+	if (proxy >= proxies.size() || proxies[proxy].index == UINT32_MAX) return;
+	const Proxy& query = proxies[proxy];
+	for (int x = query.cellMin.x; x <= query.cellMax.x; x++) {
+		for (int y = query.cellMin.y; y <= query.cellMax.y; y++) {
+			for (int z = query.cellMin.z; z <= query.cellMax.z; z++) {
+				const CellTable::Cell* cell = cells.find(glm::ivec3(x, y, z));
+				if (!cell) continue;
+				for (uint32_t slot : cell->proxies) {
+					if (slot == proxy) continue;
+					const Proxy& other = proxies[slot];
+					if (other.min.x > query.max.x || query.min.x > other.max.x) continue;
+					if (other.min.y > query.max.y || query.min.y > other.max.y) continue;
+					if (other.min.z > query.max.z || query.min.z > other.max.z) continue;
+					//same owner cell rule as the pairs, so boxes sharing several of our cells are reported once
+					if (toCell(glm::max(query.min, other.min)) != cell->coord) continue;
+					out.push_back(BoundingVolumePair{ other.index, other.boundingVolume });
+				}
+			}
+		}
+	}
+}
+
+void SpatialHashGrid::queryFrustum(const Frustum& frustum, std::vector<BoundingVolumePair>& out) const {
+	for (const Proxy& proxy : proxies) {
+		if (proxy.index != UINT32_MAX && frustum.test(proxy.min, proxy.max) != Frustum::Result::Outside) out.push_back(BoundingVolumePair{ proxy.index, proxy.boundingVolume });
+	}
+}
+
+bool SpatialHashGrid::rayCast(const Ray& ray, RayHit& hit, bool anyHit) const {
+	hit = RayHit{};
+	bool walked = walkCells(ray, ray.maxDistance, cellSize, invCellSize, proxies.size(), [&](const glm::ivec3& coord, float exit) {
+		const CellTable::Cell* cell = cells.find(coord);
+		if (cell) {
+			for (uint32_t slot : cell->proxies) {
+				if (closerHit(ray, proxies[slot].index, proxies[slot].boundingVolume, hit) && anyHit) return false;
+			}
+		}
+		return hit.distance > exit; //a hit inside the cells walked so far is closer than anything in the ones ahead
+	});
+	if (!walked) {
+		//the ray crosses more cells than there are proxies, testing them all is cheaper
+		for (const Proxy& proxy : proxies) {
+			float enter;
+			if (proxy.index == UINT32_MAX || !ray.clip(proxy.min, proxy.max, std::min(hit.distance, ray.maxDistance), enter)) continue;
+			if (closerHit(ray, proxy.index, proxy.boundingVolume, hit) && anyHit) break;
+		}
+	}
+	return hit.index != UINT32_MAX;
+}
+
+void SpatialHashGrid::getCollisionPairs(std::vector<CollisionPair>& out) const {
+	collectPairs(0, cells.cells.size(), out);
+}
+
+void SpatialHashGrid::getCollisionPairs(std::vector<CollisionPair>& out, JobSystem& jobs, WorkerPairs& workerPairs) const {
+	clearWorkerPairs(jobs, workerPairs);
+	//the owner cell rule already makes every pair unique to one cell, so ranges of the table split cleanly
+	jobs.parallelFor(static_cast<uint32_t>(cells.cells.size()), 256, [this, &workerPairs](uint32_t begin, uint32_t end, uint32_t worker) {
+		collectPairs(begin, end, workerPairs[worker]);
+	});
+	mergeWorkerPairs(out, jobs, workerPairs);
+}
+
+void SpatialHashGrid::collectPairs(size_t begin, size_t end, std::vector<CollisionPair>& out) const {
+	for (size_t c = begin; c < end; c++) {
+		const CellTable::Cell& cell = cells.cells[c];
+		const std::vector<uint32_t>& cellProxies = cell.proxies;
+		for (size_t i = 0; i < cellProxies.size(); i++) {
+			const Proxy& first = proxies[cellProxies[i]];
+			for (size_t j = i + 1; j < cellProxies.size(); j++) {
+				const Proxy& second = proxies[cellProxies[j]];
+				if (first.min.x > second.max.x || second.min.x > first.max.x) continue;
+				if (first.min.y > second.max.y || second.min.y > first.max.y) continue;
+				if (first.min.z > second.max.z || second.min.z > first.max.z) continue;
+				//boxes sharing several cells would be found in each of them, only the cell holding
+				//the min corner of their intersection reports the pair
+				if (toCell(glm::max(first.min, second.min)) != cell.coord) continue;
+				out.push_back(CollisionPair{ BoundingVolumePair{ first.index, first.boundingVolume }, BoundingVolumePair{ second.index, second.boundingVolume } });
+			}
+		}
+	}
+}
+
+ProxyHandle HierarchicalGrid::insert(uint32_t entityIndex, BoundingVolume* boundingVolume) {
+	assert(boundingVolume);
+	uint32_t slot;
+	if (!freeProxies.empty()) {
+		slot = freeProxies.back();
+		freeProxies.pop_back();
+	}
+	else {
+		slot = static_cast<uint32_t>(proxies.size());
+		proxies.emplace_back();
+	}
+	Proxy& proxy = proxies[slot];
+	proxy.index = entityIndex;
+	proxy.boundingVolume = boundingVolume;
+	proxy.min = boundingVolume->getCenter() - boundingVolume->getHalfExtent();
+	proxy.max = boundingVolume->getCenter() + boundingVolume->getHalfExtent();
+	proxy.level = chooseLevel(proxy.min, proxy.max);
+	proxy.cellMin = levels[proxy.level].toCell(proxy.min);
+	proxy.cellMax = levels[proxy.level].toCell(proxy.max);
+	addToCells(slot);
+	return slot;
+}
+
+bool HierarchicalGrid::remove(ProxyHandle proxy) {
+	if (proxy >= proxies.size() || proxies[proxy].index == UINT32_MAX) return false;
+	removeFromCells(proxy);
+	proxies[proxy].index = UINT32_MAX;
+	proxies[proxy].boundingVolume = nullptr;
+	freeProxies.push_back(proxy);
+	return true;
+}
+
+bool HierarchicalGrid::update(ProxyHandle proxy) {
+	if (proxy >= proxies.size() || proxies[proxy].index == UINT32_MAX) return false;
+	Proxy& moved = proxies[proxy];
+	moved.min = moved.boundingVolume->getCenter() - moved.boundingVolume->getHalfExtent();
+	moved.max = moved.boundingVolume->getCenter() + moved.boundingVolume->getHalfExtent();
+	uint32_t level = chooseLevel(moved.min, moved.max); //only changes with the scale
+	glm::ivec3 cellMin = levels[level].toCell(moved.min);
+	glm::ivec3 cellMax = levels[level].toCell(moved.max);
+	if (level == moved.level && cellMin == moved.cellMin && cellMax == moved.cellMax) return true;
+	removeFromCells(proxy);
+	moved.level = level;
+	moved.cellMin = cellMin;
+	moved.cellMax = cellMax;
+	addToCells(proxy);
+	return true;
+}
+
+uint32_t HierarchicalGrid::chooseLevel(const glm::vec3& min, const glm::vec3& max) {
+	glm::vec3 size = max - min;
+	float width = std::max(size.x, std::max(size.y, size.z));
+	uint32_t level = 0;
+	float cellSize = minCellSize;
+	while (cellSize < width && level + 1 < maxLevels) {
+		cellSize *= 2.0f;
+		level++;
+	}
+	while (levels.size() <= level) {
+		levels.emplace_back();
+		Level& added = levels.back();
+		added.cellSize = minCellSize * static_cast<float>(1u << (levels.size() - 1));
+		added.invCellSize = 1.0f / added.cellSize;
+	}
+	return level;
+}
+
+template<typename Func>
+void HierarchicalGrid::forEachCell(const Level& level, const glm::vec3& min, const glm::vec3& max, Func func) const {
+	glm::ivec3 cellMin = level.toCell(min);
+	glm::ivec3 cellMax = level.toCell(max);
+	glm::ivec3 span = cellMax - cellMin + glm::ivec3(1);
+	//a big box over a fine level covers far more cells than are in use, walk the table instead then
+	if (static_cast<size_t>(span.x) * span.y * span.z > level.cells.cells.size()) {
+		for (const CellTable::Cell& cell : level.cells.cells) {
+			if (!cell.used || cell.proxies.empty()) continue;
+			if (cell.coord.x < cellMin.x || cell.coord.y < cellMin.y || cell.coord.z < cellMin.z) continue;
+			if (cell.coord.x > cellMax.x || cell.coord.y > cellMax.y || cell.coord.z > cellMax.z) continue;
+			func(cell);
+		}
+		return;
+	}
+	for (int x = cellMin.x; x <= cellMax.x; x++) {
+		for (int y = cellMin.y; y <= cellMax.y; y++) {
+			for (int z = cellMin.z; z <= cellMax.z; z++) {
+				const CellTable::Cell* cell = level.cells.find(glm::ivec3(x, y, z));
+				if (cell) func(*cell);
+			}
+		}
+	}
+}
+
+void HierarchicalGrid::addToCells(uint32_t slot) {
+	const Proxy& proxy = proxies[slot];
+	Level& level = levels[proxy.level];
+	for (int x = proxy.cellMin.x; x <= proxy.cellMax.x; x++) {
+		for (int y = proxy.cellMin.y; y <= proxy.cellMax.y; y++) {
+			for (int z = proxy.cellMin.z; z <= proxy.cellMax.z; z++) {
+				level.cells.insert(glm::ivec3(x, y, z)).proxies.push_back(slot);
+			}
+		}
+	}
+	level.count++;
+}
+
+void HierarchicalGrid::removeFromCells(uint32_t slot) {
+	const Proxy& proxy = proxies[slot];
+	Level& level = levels[proxy.level];
+	for (int x = proxy.cellMin.x; x <= proxy.cellMax.x; x++) {
+		for (int y = proxy.cellMin.y; y <= proxy.cellMax.y; y++) {
+			for (int z = proxy.cellMin.z; z <= proxy.cellMax.z; z++) {
+				CellTable::Cell* cell = level.cells.find(glm::ivec3(x, y, z));
+				assert(cell);
+				std::vector<uint32_t>& cellProxies = cell->proxies;
+				auto it = std::find(cellProxies.begin(), cellProxies.end(), slot);
+				assert(it != cellProxies.end());
+				*it = cellProxies.back();
+				cellProxies.pop_back();
+			}
+		}
+	}
+	level.count--;
+}
+
+void HierarchicalGrid::getNearestObjects(ProxyHandle proxy, std::vector<BoundingVolumePair>& out) const {
+	if (proxy >= proxies.size() || proxies[proxy].index == UINT32_MAX) return;
+	const Proxy& query = proxies[proxy];
+	for (size_t l = levels.size(); l-- > 0;) {
+		const Level& level = levels[l];
+		if (level.count == 0) continue;
+		forEachCell(level, query.min, query.max, [&](const CellTable::Cell& cell) {
+			for (uint32_t slot : cell.proxies) {
+				if (slot == proxy) continue;
+				const Proxy& other = proxies[slot];
+				if (other.min.x > query.max.x || query.min.x > other.max.x) continue;
+				if (other.min.y > query.max.y || query.min.y > other.max.y) continue;
+				if (other.min.z > query.max.z || query.min.z > other.max.z) continue;
+				//owner cell rule on the level the other box lives on
+				if (level.toCell(glm::max(query.min, other.min)) != cell.coord) continue;
+				out.push_back(BoundingVolumePair{ other.index, other.boundingVolume });
+			}
+		});
+	}
+}
+
+void HierarchicalGrid::queryFrustum(const Frustum& frustum, std::vector<BoundingVolumePair>& out) const {
+	for (const Proxy& proxy : proxies) {
+		if (proxy.index != UINT32_MAX && frustum.test(proxy.min, proxy.max) != Frustum::Result::Outside) out.push_back(BoundingVolumePair{ proxy.index, proxy.boundingVolume });
+	}
+}
+
+bool HierarchicalGrid::rayCast(const Ray& ray, RayHit& hit, bool anyHit) const {
+	hit = RayHit{};
+	uint32_t linearLevels = 0; //levels the ray crosses more cells of than they hold proxies
+	for (uint32_t l = 0; l < levels.size(); l++) {
+		const Level& level = levels[l];
+		if (level.count == 0) continue;
+		bool stopped = false;
+		bool walked = walkCells(ray, std::min(hit.distance, ray.maxDistance), level.cellSize, level.invCellSize, level.count, [&](const glm::ivec3& coord, float exit) {
+			const CellTable::Cell* cell = level.cells.find(coord);
+			if (cell) {
+				for (uint32_t slot : cell->proxies) {
+					if (closerHit(ray, proxies[slot].index, proxies[slot].boundingVolume, hit) && anyHit) {
+						stopped = true;
+						return false;
+					}
+				}
+			}
+			return hit.distance > exit;
+		});
+		if (stopped) return true;
+		if (!walked) linearLevels |= 1u << l;
+	}
+	if (linearLevels != 0) {
+		for (const Proxy& proxy : proxies) {
+			float enter;
+			if (proxy.index == UINT32_MAX || !(linearLevels & (1u << proxy.level))) continue;
+			if (!ray.clip(proxy.min, proxy.max, std::min(hit.distance, ray.maxDistance), enter)) continue;
+			if (closerHit(ray, proxy.index, proxy.boundingVolume, hit) && anyHit) break;
+		}
+	}
+	return hit.index != UINT32_MAX;
+}
+
+void HierarchicalGrid::getCollisionPairs(std::vector<CollisionPair>& out) const {
+	collectPairs(0, static_cast<uint32_t>(proxies.size()), out);
+}
+
+void HierarchicalGrid::getCollisionPairs(std::vector<CollisionPair>& out, JobSystem& jobs, WorkerPairs& workerPairs) const {
+	clearWorkerPairs(jobs, workerPairs);
+	jobs.parallelFor(static_cast<uint32_t>(proxies.size()), 256, [this, &workerPairs](uint32_t begin, uint32_t end, uint32_t worker) {
+		collectPairs(begin, end, workerPairs[worker]);
+	});
+	mergeWorkerPairs(out, jobs, workerPairs);
+}
+
+void HierarchicalGrid::collectPairs(uint32_t begin, uint32_t end, std::vector<CollisionPair>& out) const {
+	for (uint32_t slot = begin; slot < end; slot++) {
+		const Proxy& first = proxies[slot];
+		if (first.index == UINT32_MAX) continue;
+		for (size_t l = first.level; l < levels.size(); l++) {
+			const Level& level = levels[l];
+			if (level.count == 0) continue;
+			//first is no wider than a cell of any of these levels, so this is at most 8 lookups each
+			forEachCell(level, first.min, first.max, [&](const CellTable::Cell& cell) {
+				for (uint32_t otherSlot : cell.proxies) {
+					if (l == first.level && otherSlot <= slot) continue; //same level pairs are seen from both sides
+					const Proxy& second = proxies[otherSlot];
+					if (first.min.x > second.max.x || second.min.x > first.max.x) continue;
+					if (first.min.y > second.max.y || second.min.y > first.max.y) continue;
+					if (first.min.z > second.max.z || second.min.z > first.max.z) continue;
+					if (level.toCell(glm::max(first.min, second.min)) != cell.coord) continue;
+					out.push_back(CollisionPair{ BoundingVolumePair{ first.index, first.boundingVolume }, BoundingVolumePair{ second.index, second.boundingVolume } });
+				}
+			});
+		}
+	}
+}
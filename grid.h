@@ -0,0 +1,108 @@
+#pragma once
+#include "scene.h"
+
+//open addressed (linear probing) table from integer cell coordinates to the proxies binned there,
+//cells are never deleted individually, empty ones are dropped the next time the table grows
+class CellTable {
+public:
+	struct Cell {
+		glm::ivec3 coord{ 0 };
+		std::vector<uint32_t> proxies;
+		bool used = false;
+	};
+	CellTable() : cells(64) {}
+	Cell& insert(const glm::ivec3& coord);
+	Cell* find(const glm::ivec3& coord);
+	const Cell* find(const glm::ivec3& coord) const;
+	void clear();
+	std::vector<Cell> cells;
+private:
+	size_t numUsed = 0;
+	void grow();
+	static size_t hash(const glm::ivec3& coord) {
+		return static_cast<size_t>((static_cast<uint32_t>(coord.x) * 73856093u) ^ (static_cast<uint32_t>(coord.y) * 19349663u) ^ (static_cast<uint32_t>(coord.z) * 83492791u));
+	}
+};
+
+//handles are slots in proxies
+class SpatialHashGrid : public SpatialPartition {
+public:
+	SpatialHashGrid(float cellSize = gridCellSize) : cellSize{ cellSize }, invCellSize{ 1.0f / cellSize } {}
+	void getNearestObjects(ProxyHandle proxy, std::vector<BoundingVolumePair>& out) const override;
+	void queryFrustum(const Frustum& frustum, std::vector<BoundingVolumePair>& out) const override;
+	bool rayCast(const Ray& ray, RayHit& hit, bool anyHit = false) const override;
+	ProxyHandle insert(uint32_t entityIndex, BoundingVolume* boundingVolume) override;
+	bool remove(ProxyHandle proxy) override;
+	bool update(ProxyHandle proxy) override;
+	void getCollisionPairs(std::vector<CollisionPair>& out) const override;
+	void getCollisionPairs(std::vector<CollisionPair>& out, JobSystem& jobs, WorkerPairs& workerPairs) const override;
+	float getCellSize() const { return cellSize; }
+private:
+	struct Proxy {
+		uint32_t index = UINT32_MAX; //entity index, UINT32_MAX while the slot is free
+		BoundingVolume* boundingVolume = nullptr;
+		glm::vec3 min{ 0.0f };
+		glm::vec3 max{ 0.0f };
+		glm::ivec3 cellMin{ 0 };
+		glm::ivec3 cellMax{ 0 };
+	};
+	float cellSize;
+	float invCellSize;
+	CellTable cells;
+	std::vector<Proxy> proxies;
+	std::vector<uint32_t> freeProxies;
+	glm::ivec3 toCell(const glm::vec3& pos) const {
+		return glm::ivec3(glm::floor(pos * invCellSize));
+	}
+	void addToCells(uint32_t slot);
+	void removeFromCells(uint32_t slot);
+	void collectPairs(size_t begin, size_t end, std::vector<CollisionPair>& out) const; //pairs owned by cells [begin, end) of the table
+};
+
+//stack of hashed grids, each level's cells twice as wide as the one below. a box goes into the finest level
+//whose cells are at least as wide as the box, so it covers at most 2 cells per axis there no matter how big
+//it is. pairs are found from the finer box of the two, against its own level and every coarser one
+//handles are slots in proxies
+class HierarchicalGrid : public SpatialPartition {
+public:
+	HierarchicalGrid(float minCellSize = hgridMinCellSize) : minCellSize{ minCellSize } {}
+	void getNearestObjects(ProxyHandle proxy, std::vector<BoundingVolumePair>& out) const override;
+	void queryFrustum(const Frustum& frustum, std::vector<BoundingVolumePair>& out) const override;
+	bool rayCast(const Ray& ray, RayHit& hit, bool anyHit = false) const override;
+	ProxyHandle insert(uint32_t entityIndex, BoundingVolume* boundingVolume) override;
+	bool remove(ProxyHandle proxy) override;
+	bool update(ProxyHandle proxy) override;
+	void getCollisionPairs(std::vector<CollisionPair>& out) const override;
+	void getCollisionPairs(std::vector<CollisionPair>& out, JobSystem& jobs, WorkerPairs& workerPairs) const override;
+	size_t getLevelCount() const { return levels.size(); }
+private:
+	static constexpr uint32_t maxLevels = 24;
+	struct Level {
+		float cellSize = 0.0f;
+		float invCellSize = 0.0f;
+		CellTable cells;
+		uint32_t count = 0; //proxies living on this level, empty levels are skipped
+		glm::ivec3 toCell(const glm::vec3& pos) const {
+			return glm::ivec3(glm::floor(pos * invCellSize));
+		}
+	};
+	struct Proxy {
+		uint32_t index = UINT32_MAX; //entity index, UINT32_MAX while the slot is free
+		BoundingVolume* boundingVolume = nullptr;
+		glm::vec3 min{ 0.0f };
+		glm::vec3 max{ 0.0f };
+		uint32_t level = 0;
+		glm::ivec3 cellMin{ 0 }; //on its own level
+		glm::ivec3 cellMax{ 0 };
+	};
+	float minCellSize;
+	std::vector<Level> levels; //added as boxes big enough to need them show up
+	std::vector<Proxy> proxies;
+	std::vector<uint32_t> freeProxies;
+	uint32_t chooseLevel(const glm::vec3& min, const glm::vec3& max);
+	template<typename Func>
+	void forEachCell(const Level& level, const glm::vec3& min, const glm::vec3& max, Func func) const;
+	void addToCells(uint32_t slot);
+	void removeFromCells(uint32_t slot);
+	void collectPairs(uint32_t begin, uint32_t end, std::vector<CollisionPair>& out) const; //pairs found from proxies [begin, end)
+};
@@ -0,0 +1,65 @@
+#include "jobs.h"
+#include <algorithm>
+
+JobSystem::JobSystem(uint32_t numThreads) {
+	if (numThreads == 0) numThreads = std::max(std::thread::hardware_concurrency(), 1u) - 1;
+	threads.reserve(numThreads);
+	for (uint32_t i = 0; i < numThreads; i++) {
+		threads.emplace_back(&JobSystem::threadLoop, this, i + 1);
+	}
+}
+
+JobSystem::~JobSystem() {
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		quit = true;
+	}
+	wake.notify_all();
+	for (std::thread& thread : threads) thread.join();
+}
+
+void JobSystem::run(uint32_t count, uint32_t chunkSize, Task task, void* context) {
+	if (count == 0) return;
+	chunkSize = std::max(chunkSize, 1u);
+	if (threads.empty() || count <= chunkSize) {
+		task(context, 0, count, 0); //not worth waking anyone
+		return;
+	}
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		this->task = task;
+		this->context = context;
+		this->count = count;
+		this->chunkSize = chunkSize;
+		nextChunk.store(0, std::memory_order_relaxed);
+		busyThreads = static_cast<uint32_t>(threads.size());
+		generation++;
+	}
+	wake.notify_all();
+	work(0);
+	std::unique_lock<std::mutex> lock(mutex);
+	finished.wait(lock, [this] { return busyThreads == 0; });
+}
+
+void JobSystem::work(uint32_t worker) {
+	uint32_t numChunks = (count + chunkSize - 1) / chunkSize;
+	for (uint32_t chunk = nextChunk.fetch_add(1); chunk < numChunks; chunk = nextChunk.fetch_add(1)) {
+		uint32_t begin = chunk * chunkSize;
+		task(context, begin, std::min(begin + chunkSize, count), worker);
+	}
+}
+
+void JobSystem::threadLoop(uint32_t worker) {
+	uint32_t seen = 0;
+	while (true) {
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			wake.wait(lock, [this, seen] { return quit || generation != seen; });
+			if (quit) return;
+			seen = generation;
+		}
+		work(worker);
+		std::lock_guard<std::mutex> lock(mutex);
+		if (--busyThreads == 0) finished.notify_one();
+	}
+}
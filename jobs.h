@@ -0,0 +1,47 @@
+#pragma once
+#include "config.h"
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+//fixed set of worker threads that sleep between calls, parallelFor hands out chunks of an index range
+//and the calling thread works alongside them, so a pool of n threads gives n + 1 workers. only one
+//thread may call parallelFor at a time and func must not call it again
+class JobSystem {
+public:
+	//0 picks one thread per core besides the caller
+	explicit JobSystem(uint32_t numThreads = 0);
+	~JobSystem();
+	JobSystem(const JobSystem&) = delete;
+	JobSystem& operator=(const JobSystem&) = delete;
+	uint32_t getWorkerCount() const { return static_cast<uint32_t>(threads.size()) + 1; }
+	//calls func(begin, end, worker) over [0, count) in chunks of chunkSize, worker is in [0, getWorkerCount())
+	//and no two chunks run on the same worker at once, returns after every chunk is done
+	template<typename Func>
+	void parallelFor(uint32_t count, uint32_t chunkSize, Func&& func) {
+		using FuncType = typename std::remove_reference<Func>::type;
+		run(count, chunkSize, [](void* context, uint32_t begin, uint32_t end, uint32_t worker) {
+			(*static_cast<FuncType*>(context))(begin, end, worker);
+		}, &func);
+	}
+private:
+	using Task = void(*)(void* context, uint32_t begin, uint32_t end, uint32_t worker);
+	std::vector<std::thread> threads;
+	std::mutex mutex;
+	std::condition_variable wake;
+	std::condition_variable finished;
+	Task task = nullptr;
+	void* context = nullptr;
+	uint32_t count = 0;
+	uint32_t chunkSize = 1;
+	std::atomic<uint32_t> nextChunk{ 0 };
+	uint32_t generation = 0; //bumped for every parallelFor so sleeping threads know there is new work
+	uint32_t busyThreads = 0;
+	bool quit = false;
+	void run(uint32_t count, uint32_t chunkSize, Task task, void* context);
+	void work(uint32_t worker);
+	void threadLoop(uint32_t worker);
+};
@@ -6,9 +6,19 @@
 #include "scene.h"
 #include <vector>
 #include "physics.h"
+#include "grid.h"
+#include "bvh.h"
+#include "mbp.h"
+#include "octree.h"
 #include <chrono>
 
 //NullPartition nullPartition;
+//SortedAABBArray sortedAABBArray;
+//SpatialHashGrid spatialHashGrid;
+//HierarchicalGrid hierarchicalGrid;
+//AABBTree aabbTree;
+//LooseOctree looseOctree;
+//MultiBoxPruning multiBoxPruning;
 SortedAABBList sortedAABBList;
 
 EntityManager entityManager{ sortedAABBList };
@@ -43,7 +53,8 @@ int main(int argc, char* argv[]) {
     callbackData.camera = &camera;
 
     renderer.startUp(window, &callbackData, entityManager);
-    loadScene(entityManager, "scene.json", renderer.cubeMesh, renderer.sphereMesh);
+    const char* scenePath = argc > 1 ? argv[1] : "scene.json"; //e.g. one written by Benchmark generate
+    loadScene(entityManager, scenePath, renderer.cubeMesh, renderer.sphereMesh);
 
     glfwSetCursorPosCallback(window, cursorPositionCallback);
 
@@ -59,7 +70,7 @@ int main(int argc, char* argv[]) {
         physicsManager.runPhysics2(entityManager);
         //auto finish = std::chrono::high_resolution_clock::now();
         //std::cout << std::chrono::duration_cast<std::chrono::nanoseconds>(finish - start).count() << "ns\n";
-        renderer.renderFrame(window, entityManager, uiState);
+        renderer.renderFrame(window, entityManager, physicsManager, uiState);
 
         double currentTime = glfwGetTime();
         deltaTime = currentTime - previousTime; //measures time taken to process and submit work for a frame to be shown
@@ -68,8 +79,8 @@ int main(int argc, char* argv[]) {
         glfwPollEvents();
         processKeyboard(window, camera, deltaTime);
     }
-    storeScene(entityManager, "scene.json");
-    renderer.shutDown(entityManager);
+    storeScene(entityManager, "scene.json"); //never back over a scene given on the command line, generated ones stay as seeded
+    renderer.shutDown(entityManager, physicsManager);
     glfwDestroyWindow(window);
     glfwTerminate();
 
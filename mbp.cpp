@@ -0,0 +1,192 @@
+#include "mbp.h"
+#include "jobs.h"
+#include <algorithm>
+
+static inline glm::vec3 minCorner(BoundingVolume* boundingVolume) {
+	return boundingVolume->getCenter() - boundingVolume->getHalfExtent();
+}
+
+ProxyHandle MultiBoxPruning::insert(uint32_t entityIndex, BoundingVolume* boundingVolume) {
+	assert(boundingVolume);
+	uint32_t slot;
+	if (!freeProxies.empty()) {
+		slot = freeProxies.back();
+		freeProxies.pop_back();
+	}
+	else {
+		slot = static_cast<uint32_t>(proxies.size());
+		proxies.emplace_back();
+	}
+	Proxy& proxy = proxies[slot];
+	proxy.index = entityIndex;
+	proxy.boundingVolume = boundingVolume;
+	proxy.regionMin = toRegion(minCorner(boundingVolume));
+	proxy.regionMax = toRegion(boundingVolume->getCenter() + boundingVolume->getHalfExtent());
+	addToRegions(slot);
+	return slot;
+}
+
+bool MultiBoxPruning::remove(ProxyHandle proxy) {
+	if (proxy >= proxies.size() || proxies[proxy].index == UINT32_MAX) return false;
+	removeFromRegions(proxy);
+	proxies[proxy].index = UINT32_MAX;
+	proxies[proxy].boundingVolume = nullptr;
+	freeProxies.push_back(proxy);
+	return true;
+}
+
+bool MultiBoxPruning::update(ProxyHandle proxy) {
+	if (proxy >= proxies.size() || proxies[proxy].index == UINT32_MAX) return false;
+	Proxy& moved = proxies[proxy];
+	glm::ivec3 regionMin = toRegion(minCorner(moved.boundingVolume));
+	glm::ivec3 regionMax = toRegion(moved.boundingVolume->getCenter() + moved.boundingVolume->getHalfExtent());
+	if (regionMin == moved.regionMin && regionMax == moved.regionMax) {
+		//common case, the regions just re-read the bounds on their next sort
+		for (const RegionProxy& regionProxy : moved.regions) regions[regionProxy.region].partition.update(regionProxy.handle);
+		return true;
+	}
+	//crossing a border is rare enough that moving over every region isn't worth diffing the two ranges
+	removeFromRegions(proxy);
+	moved.regionMin = regionMin;
+	moved.regionMax = regionMax;
+	addToRegions(proxy);
+	return true;
+}
+
+uint32_t MultiBoxPruning::acquireRegion(const glm::ivec3& coord) {
+	auto it = regionIndices.find(regionKey(coord));
+	if (it != regionIndices.end()) return it->second;
+	uint32_t region;
+	if (!freeRegions.empty()) {
+		region = freeRegions.back();
+		freeRegions.pop_back();
+	}
+	else {
+		region = static_cast<uint32_t>(regions.size());
+		regions.emplace_back();
+	}
+	regions[region].coord = coord;
+	regionIndices.emplace(regionKey(coord), region);
+	return region;
+}
+
+void MultiBoxPruning::addToRegions(uint32_t slot) {
+	Proxy& proxy = proxies[slot];
+	for (int x = proxy.regionMin.x; x <= proxy.regionMax.x; x++) {
+		for (int y = proxy.regionMin.y; y <= proxy.regionMax.y; y++) {
+			for (int z = proxy.regionMin.z; z <= proxy.regionMax.z; z++) {
+				uint32_t region = acquireRegion(glm::ivec3(x, y, z));
+				regions[region].count++;
+				proxy.regions.push_back(RegionProxy{ region, regions[region].partition.insert(proxy.index, proxy.boundingVolume) });
+			}
+		}
+	}
+	if (proxy.regions.size() > 1) {
+		for (const RegionProxy& regionProxy : proxy.regions) regions[regionProxy.region].straddlers++;
+	}
+}
+
+void MultiBoxPruning::removeFromRegions(uint32_t slot) {
+	Proxy& proxy = proxies[slot];
+	bool straddles = proxy.regions.size() > 1;
+	for (const RegionProxy& regionProxy : proxy.regions) {
+		Region& region = regions[regionProxy.region];
+		region.partition.remove(regionProxy.handle);
+		if (straddles) region.straddlers--;
+		if (--region.count > 0) continue;
+		//its partition still holds the dead endpoints, the first sort after it's handed out again drops them
+		regionIndices.erase(regionKey(region.coord));
+		freeRegions.push_back(regionProxy.region);
+	}
+	proxy.regions.clear();
+}
+
+void MultiBoxPruning::flushUpdates() {
+	SpatialPartition::flushUpdates();
+	for (Region& region : regions) {
+		if (region.count > 0) region.partition.flushUpdates();
+	}
+}
+
+void MultiBoxPruning::flushUpdates(JobSystem& jobs) {
+	//moves between regions touch the shared tables so they stay on this thread, the sorts don't
+	SpatialPartition::flushUpdates();
+	jobs.parallelFor(static_cast<uint32_t>(regions.size()), 1, [this](uint32_t begin, uint32_t end, uint32_t) {
+		for (uint32_t i = begin; i < end; i++) {
+			if (regions[i].count > 0) regions[i].partition.flushUpdates();
+		}
+	});
+}
+
+void MultiBoxPruning::getNearestObjects(ProxyHandle proxy, std::vector<BoundingVolumePair>& out) const {
+	if (proxy >= proxies.size() || proxies[proxy].index == UINT32_MAX) return;
+	const Proxy& query = proxies[proxy];
+	glm::vec3 queryMin = minCorner(query.boundingVolume);
+	for (const RegionProxy& regionProxy : query.regions) {
+		const Region& region = regions[regionProxy.region];
+		size_t first = out.size();
+		region.partition.getNearestObjects(regionProxy.handle, out);
+		if (query.regions.size() == 1) continue;
+		//same owner rule as the pairs
+		out.erase(std::remove_if(out.begin() + first, out.end(), [this, &region, &queryMin](const BoundingVolumePair& other) {
+			return toRegion(glm::max(queryMin, minCorner(other.second))) != region.coord;
+		}), out.end());
+	}
+}
+
+void MultiBoxPruning::queryFrustum(const Frustum& frustum, std::vector<BoundingVolumePair>& out) const {
+	//straight over the proxies, through the regions boxes on a border would come up more than once
+	for (const Proxy& proxy : proxies) {
+		if (proxy.index == UINT32_MAX) continue;
+		glm::vec3 min = minCorner(proxy.boundingVolume);
+		glm::vec3 max = proxy.boundingVolume->getCenter() + proxy.boundingVolume->getHalfExtent();
+		if (frustum.test(min, max) != Frustum::Result::Outside) out.push_back(BoundingVolumePair{ proxy.index, proxy.boundingVolume });
+	}
+}
+
+bool MultiBoxPruning::rayCast(const Ray& ray, RayHit& hit, bool anyHit) const {
+	hit = RayHit{};
+	//regions in the order the ray passes them, each asked for its closest hit short of the best one so far
+	auto castRegion = [&ray, &hit, anyHit](const Region& region) {
+		Ray limited = ray;
+		limited.maxDistance = std::min(hit.distance, ray.maxDistance);
+		RayHit regionHit;
+		if (region.partition.rayCast(limited, regionHit, anyHit) && regionHit.distance < hit.distance) hit = regionHit;
+		return anyHit && hit.index != UINT32_MAX;
+	};
+	bool walked = walkCells(ray, ray.maxDistance, regionSize, invRegionSize, regionIndices.size(), [&](const glm::ivec3& coord, float exit) {
+		auto it = regionIndices.find(regionKey(coord));
+		if (it != regionIndices.end() && castRegion(regions[it->second])) return false;
+		return hit.distance > exit;
+	});
+	if (!walked) {
+		for (const Region& region : regions) {
+			if (region.count > 0 && castRegion(region)) break;
+		}
+	}
+	return hit.index != UINT32_MAX;
+}
+
+void MultiBoxPruning::getCollisionPairs(std::vector<CollisionPair>& out) const {
+	for (uint32_t region = 0; region < regions.size(); region++) collectPairs(region, out);
+}
+
+void MultiBoxPruning::getCollisionPairs(std::vector<CollisionPair>& out, JobSystem& jobs, WorkerPairs& workerPairs) const {
+	clearWorkerPairs(jobs, workerPairs);
+	jobs.parallelFor(static_cast<uint32_t>(regions.size()), 1, [this, &workerPairs](uint32_t begin, uint32_t end, uint32_t worker) {
+		for (uint32_t region = begin; region < end; region++) collectPairs(region, workerPairs[worker]);
+	});
+	mergeWorkerPairs(out, jobs, workerPairs);
+}
+
+void MultiBoxPruning::collectPairs(uint32_t index, std::vector<CollisionPair>& out) const {
+	const Region& region = regions[index];
+	if (region.count < 2) return;
+	size_t first = out.size();
+	region.partition.getCollisionPairs(out);
+	if (region.straddlers < 2) return;
+	//a pair turns up in every region both boxes are in, only the one holding the min corner of the overlap keeps it
+	out.erase(std::remove_if(out.begin() + first, out.end(), [this, &region](const CollisionPair& pair) {
+		return toRegion(glm::max(minCorner(pair.first.second), minCorner(pair.second.second))) != region.coord;
+	}), out.end());
+}
@@ -0,0 +1,59 @@
+#pragma once
+#include "scene.h"
+
+//multi box pruning: the world is cut into a grid of cubic regions, each its own SortedAABBArray, so a box
+//only ever sorts against what shares its region. boxes on a border go into every region they touch and
+//a pair is kept only by the region holding the min corner of the overlap. regions exist while they hold
+//something and are sorted and swept independently, on the job system when there is one
+//handles are slots in proxies
+class MultiBoxPruning : public SpatialPartition {
+public:
+	MultiBoxPruning(float regionSize = mbpRegionSize) : regionSize{ regionSize }, invRegionSize{ 1.0f / regionSize } {}
+	void getNearestObjects(ProxyHandle proxy, std::vector<BoundingVolumePair>& out) const override;
+	void queryFrustum(const Frustum& frustum, std::vector<BoundingVolumePair>& out) const override;
+	bool rayCast(const Ray& ray, RayHit& hit, bool anyHit = false) const override;
+	ProxyHandle insert(uint32_t entityIndex, BoundingVolume* boundingVolume) override;
+	bool remove(ProxyHandle proxy) override;
+	bool update(ProxyHandle proxy) override;
+	void flushUpdates() override;
+	void flushUpdates(JobSystem& jobs) override;
+	void getCollisionPairs(std::vector<CollisionPair>& out) const override;
+	void getCollisionPairs(std::vector<CollisionPair>& out, JobSystem& jobs, WorkerPairs& workerPairs) const override;
+	float getRegionSize() const { return regionSize; }
+	size_t getRegionCount() const { return regionIndices.size(); }
+private:
+	struct Region {
+		glm::ivec3 coord{ 0 };
+		SortedAABBArray partition;
+		uint32_t count = 0; //proxies in it, the region is recycled at 0
+		uint32_t straddlers = 0; //of those, how many sit in other regions too. pairs need deduplicating only from 2 on
+	};
+	struct RegionProxy {
+		uint32_t region;
+		ProxyHandle handle; //from the region's partition
+	};
+	struct Proxy {
+		uint32_t index = UINT32_MAX; //entity index, UINT32_MAX while the slot is free
+		BoundingVolume* boundingVolume = nullptr;
+		glm::ivec3 regionMin{ 0 };
+		glm::ivec3 regionMax{ 0 };
+		std::vector<RegionProxy> regions;
+	};
+	float regionSize;
+	float invRegionSize;
+	std::vector<Region> regions;
+	std::vector<uint32_t> freeRegions;
+	std::unordered_map<uint64_t, uint32_t> regionIndices; //packed coord to slot in regions
+	std::vector<Proxy> proxies;
+	std::vector<uint32_t> freeProxies;
+	glm::ivec3 toRegion(const glm::vec3& pos) const {
+		return glm::ivec3(glm::floor(pos * invRegionSize));
+	}
+	static uint64_t regionKey(const glm::ivec3& coord) { //21 bits per axis, a million regions each way
+		return (static_cast<uint64_t>(coord.x & 0x1FFFFF) << 42) | (static_cast<uint64_t>(coord.y & 0x1FFFFF) << 21) | static_cast<uint64_t>(coord.z & 0x1FFFFF);
+	}
+	uint32_t acquireRegion(const glm::ivec3& coord);
+	void addToRegions(uint32_t slot);
+	void removeFromRegions(uint32_t slot);
+	void collectPairs(uint32_t region, std::vector<CollisionPair>& out) const;
+};
@@ -0,0 +1,410 @@
+#include "narrowphase.h"
+#include <cstddef>
+#if HAS_SSE2
+#include <immintrin.h>
+#endif
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+//the wider kernels are compiled for their instruction sets on their own and only called once the CPU said it has
+//them, MSVC takes the intrinsics without any flags
+#if HAS_SSE2 && !defined(_MSC_VER)
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#define TARGET_AVX512 __attribute__((target("avx512f")))
+#else
+#define TARGET_AVX2
+#define TARGET_AVX512
+#endif
+
+using Bucket = Narrowphase::Bucket;
+
+static inline uint32_t lowestBit(uint64_t bits) {
+#if defined(_MSC_VER)
+	unsigned long index;
+	_BitScanForward64(&index, bits);
+	return index;
+#else
+	return __builtin_ctzll(bits);
+#endif
+}
+
+static inline void setHits(const Bucket& bucket, size_t first, uint32_t bits, uint64_t* hits) {
+	//tail lanes are padding
+	size_t count = std::min<size_t>(bucket.size() - first, Narrowphase::maxLanes);
+	for (size_t j = 0; j < count; j++) {
+		if (!((bits >> j) & 1)) continue;
+		uint32_t pair = bucket.pairs[first + j];
+		hits[pair >> 6] |= uint64_t(1) << (pair & 63);
+	}
+}
+
+static void boxBoxScalar(const Bucket& b, uint64_t* hits) {
+	for (size_t i = 0; i < b.size(); i++) {
+		bool overlap = true;
+		for (int k = 0; k < 3; k++) overlap &= b.lane(k)[i] <= b.lane(9 + k)[i] && b.lane(6 + k)[i] <= b.lane(3 + k)[i];
+		if (overlap) setHits(b, i, 1, hits);
+	}
+}
+
+static void sphereSphereScalar(const Bucket& b, uint64_t* hits) {
+	for (size_t i = 0; i < b.size(); i++) {
+		float dx = b.lane(0)[i] - b.lane(4)[i];
+		float dy = b.lane(1)[i] - b.lane(5)[i];
+		float dz = b.lane(2)[i] - b.lane(6)[i];
+		float radiusSum = b.lane(3)[i] + b.lane(7)[i];
+		if (dx * dx + dy * dy + dz * dz <= radiusSum * radiusSum) setHits(b, i, 1, hits);
+	}
+}
+
+static void boxSphereScalar(const Bucket& b, uint64_t* hits) {
+	for (size_t i = 0; i < b.size(); i++) {
+		float e[3];
+		for (int k = 0; k < 3; k++) e[k] = std::max(b.lane(k)[i] - b.lane(6 + k)[i], 0.0f) + std::max(b.lane(6 + k)[i] - b.lane(3 + k)[i], 0.0f);
+		if (e[0] * e[0] + e[1] * e[1] + e[2] * e[2] <= b.lane(9)[i] * b.lane(9)[i]) setHits(b, i, 1, hits);
+	}
+}
+
+#if HAS_SSE2
+static void boxBoxSSE2(const Bucket& b, uint64_t* hits) {
+	for (size_t i = 0; i < b.size(); i += 4) {
+		__m128 overlap = _mm_castsi128_ps(_mm_set1_epi32(-1));
+		for (int k = 0; k < 3; k++) {
+			overlap = _mm_and_ps(overlap, _mm_cmple_ps(_mm_loadu_ps(b.lane(k) + i), _mm_loadu_ps(b.lane(9 + k) + i)));
+			overlap = _mm_and_ps(overlap, _mm_cmple_ps(_mm_loadu_ps(b.lane(6 + k) + i), _mm_loadu_ps(b.lane(3 + k) + i)));
+		}
+		uint32_t bits = static_cast<uint32_t>(_mm_movemask_ps(overlap));
+		if (bits) setHits(b, i, bits, hits);
+	}
+}
+
+static void sphereSphereSSE2(const Bucket& b, uint64_t* hits) {
+	for (size_t i = 0; i < b.size(); i += 4) {
+		__m128 dx = _mm_sub_ps(_mm_loadu_ps(b.lane(0) + i), _mm_loadu_ps(b.lane(4) + i));
+		__m128 dy = _mm_sub_ps(_mm_loadu_ps(b.lane(1) + i), _mm_loadu_ps(b.lane(5) + i));
+		__m128 dz = _mm_sub_ps(_mm_loadu_ps(b.lane(2) + i), _mm_loadu_ps(b.lane(6) + i));
+		__m128 radiusSum = _mm_add_ps(_mm_loadu_ps(b.lane(3) + i), _mm_loadu_ps(b.lane(7) + i));
+		__m128 distanceSq = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+		uint32_t bits = static_cast<uint32_t>(_mm_movemask_ps(_mm_cmple_ps(distanceSq, _mm_mul_ps(radiusSum, radiusSum))));
+		if (bits) setHits(b, i, bits, hits);
+	}
+}
+
+static void boxSphereSSE2(const Bucket& b, uint64_t* hits) {
+	__m128 zero = _mm_setzero_ps();
+	for (size_t i = 0; i < b.size(); i += 4) {
+		__m128 distanceSq = zero;
+		for (int k = 0; k < 3; k++) {
+			__m128 center = _mm_loadu_ps(b.lane(6 + k) + i);
+			__m128 e = _mm_add_ps(_mm_max_ps(_mm_sub_ps(_mm_loadu_ps(b.lane(k) + i), center), zero), _mm_max_ps(_mm_sub_ps(center, _mm_loadu_ps(b.lane(3 + k) + i)), zero));
+			distanceSq = k == 0 ? _mm_mul_ps(e, e) : _mm_add_ps(distanceSq, _mm_mul_ps(e, e));
+		}
+		__m128 radius = _mm_loadu_ps(b.lane(9) + i);
+		uint32_t bits = static_cast<uint32_t>(_mm_movemask_ps(_mm_cmple_ps(distanceSq, _mm_mul_ps(radius, radius))));
+		if (bits) setHits(b, i, bits, hits);
+	}
+}
+
+TARGET_AVX2 static void boxBoxAVX2(const Bucket& b, uint64_t* hits) {
+	for (size_t i = 0; i < b.size(); i += 8) {
+		__m256 overlap = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+		for (int k = 0; k < 3; k++) {
+			overlap = _mm256_and_ps(overlap, _mm256_cmp_ps(_mm256_loadu_ps(b.lane(k) + i), _mm256_loadu_ps(b.lane(9 + k) + i), _CMP_LE_OQ));
+			overlap = _mm256_and_ps(overlap, _mm256_cmp_ps(_mm256_loadu_ps(b.lane(6 + k) + i), _mm256_loadu_ps(b.lane(3 + k) + i), _CMP_LE_OQ));
+		}
+		uint32_t bits = static_cast<uint32_t>(_mm256_movemask_ps(overlap));
+		if (bits) setHits(b, i, bits, hits);
+	}
+}
+
+TARGET_AVX2 static void sphereSphereAVX2(const Bucket& b, uint64_t* hits) {
+	for (size_t i = 0; i < b.size(); i += 8) {
+		__m256 dx = _mm256_sub_ps(_mm256_loadu_ps(b.lane(0) + i), _mm256_loadu_ps(b.lane(4) + i));
+		__m256 dy = _mm256_sub_ps(_mm256_loadu_ps(b.lane(1) + i), _mm256_loadu_ps(b.lane(5) + i));
+		__m256 dz = _mm256_sub_ps(_mm256_loadu_ps(b.lane(2) + i), _mm256_loadu_ps(b.lane(6) + i));
+		__m256 radiusSum = _mm256_add_ps(_mm256_loadu_ps(b.lane(3) + i), _mm256_loadu_ps(b.lane(7) + i));
+		__m256 distanceSq = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy)), _mm256_mul_ps(dz, dz));
+		uint32_t bits = static_cast<uint32_t>(_mm256_movemask_ps(_mm256_cmp_ps(distanceSq, _mm256_mul_ps(radiusSum, radiusSum), _CMP_LE_OQ)));
+		if (bits) setHits(b, i, bits, hits);
+	}
+}
+
+TARGET_AVX2 static void boxSphereAVX2(const Bucket& b, uint64_t* hits) {
+	__m256 zero = _mm256_setzero_ps();
+	for (size_t i = 0; i < b.size(); i += 8) {
+		__m256 distanceSq = zero;
+		for (int k = 0; k < 3; k++) {
+			__m256 center = _mm256_loadu_ps(b.lane(6 + k) + i);
+			__m256 e = _mm256_add_ps(_mm256_max_ps(_mm256_sub_ps(_mm256_loadu_ps(b.lane(k) + i), center), zero), _mm256_max_ps(_mm256_sub_ps(center, _mm256_loadu_ps(b.lane(3 + k) + i)), zero));
+			distanceSq = k == 0 ? _mm256_mul_ps(e, e) : _mm256_add_ps(distanceSq, _mm256_mul_ps(e, e));
+		}
+		__m256 radius = _mm256_loadu_ps(b.lane(9) + i);
+		uint32_t bits = static_cast<uint32_t>(_mm256_movemask_ps(_mm256_cmp_ps(distanceSq, _mm256_mul_ps(radius, radius), _CMP_LE_OQ)));
+		if (bits) setHits(b, i, bits, hits);
+	}
+}
+
+TARGET_AVX512 static void boxBoxAVX512(const Bucket& b, uint64_t* hits) {
+	for (size_t i = 0; i < b.size(); i += 16) {
+		__mmask16 overlap = 0xFFFF;
+		for (int k = 0; k < 3; k++) {
+			overlap &= _mm512_cmp_ps_mask(_mm512_loadu_ps(b.lane(k) + i), _mm512_loadu_ps(b.lane(9 + k) + i), _CMP_LE_OQ);
+			overlap &= _mm512_cmp_ps_mask(_mm512_loadu_ps(b.lane(6 + k) + i), _mm512_loadu_ps(b.lane(3 + k) + i), _CMP_LE_OQ);
+		}
+		if (overlap) setHits(b, i, overlap, hits);
+	}
+}
+
+TARGET_AVX512 static void sphereSphereAVX512(const Bucket& b, uint64_t* hits) {
+	for (size_t i = 0; i < b.size(); i += 16) {
+		__m512 dx = _mm512_sub_ps(_mm512_loadu_ps(b.lane(0) + i), _mm512_loadu_ps(b.lane(4) + i));
+		__m512 dy = _mm512_sub_ps(_mm512_loadu_ps(b.lane(1) + i), _mm512_loadu_ps(b.lane(5) + i));
+		__m512 dz = _mm512_sub_ps(_mm512_loadu_ps(b.lane(2) + i), _mm512_loadu_ps(b.lane(6) + i));
+		__m512 radiusSum = _mm512_add_ps(_mm512_loadu_ps(b.lane(3) + i), _mm512_loadu_ps(b.lane(7) + i));
+		__m512 distanceSq = _mm512_add_ps(_mm512_add_ps(_mm512_mul_ps(dx, dx), _mm512_mul_ps(dy, dy)), _mm512_mul_ps(dz, dz));
+		__mmask16 bits = _mm512_cmp_ps_mask(distanceSq, _mm512_mul_ps(radiusSum, radiusSum), _CMP_LE_OQ);
+		if (bits) setHits(b, i, bits, hits);
+	}
+}
+
+TARGET_AVX512 static void boxSphereAVX512(const Bucket& b, uint64_t* hits) {
+	__m512 zero = _mm512_setzero_ps();
+	for (size_t i = 0; i < b.size(); i += 16) {
+		__m512 distanceSq = zero;
+		for (int k = 0; k < 3; k++) {
+			__m512 center = _mm512_loadu_ps(b.lane(6 + k) + i);
+			__m512 e = _mm512_add_ps(_mm512_max_ps(_mm512_sub_ps(_mm512_loadu_ps(b.lane(k) + i), center), zero), _mm512_max_ps(_mm512_sub_ps(center, _mm512_loadu_ps(b.lane(3 + k) + i)), zero));
+			distanceSq = k == 0 ? _mm512_mul_ps(e, e) : _mm512_add_ps(distanceSq, _mm512_mul_ps(e, e));
+		}
+		__m512 radius = _mm512_loadu_ps(b.lane(9) + i);
+		__mmask16 bits = _mm512_cmp_ps_mask(distanceSq, _mm512_mul_ps(radius, radius), _CMP_LE_OQ);
+		if (bits) setHits(b, i, bits, hits);
+	}
+}
+#endif
+
+Narrowphase::Kernel Narrowphase::getBestKernel() {
+	static const Kernel best = [] {
+#if HAS_SSE2
+#ifdef _MSC_VER
+		int info[4];
+		__cpuid(info, 0);
+		int maxLeaf = info[0];
+		__cpuid(info, 1);
+		//the OS has to save the wider registers too, which XCR0 tells
+		bool osSaves = (info[2] & (1 << 27)) != 0;
+		uint64_t xcr0 = osSaves ? _xgetbv(0) : 0;
+		bool avx2 = false, avx512 = false;
+		if (maxLeaf >= 7) {
+			__cpuidex(info, 7, 0);
+			avx2 = (info[1] & (1 << 5)) != 0 && (xcr0 & 0x6) == 0x6;
+			avx512 = (info[1] & (1 << 16)) != 0 && (xcr0 & 0xE6) == 0xE6;
+		}
+#else
+		__builtin_cpu_init();
+		bool avx2 = __builtin_cpu_supports("avx2");
+		bool avx512 = __builtin_cpu_supports("avx512f");
+#endif
+		if (avx512) return Kernel::AVX512;
+		if (avx2) return Kernel::AVX2;
+		return Kernel::SSE2;
+#else
+		return Kernel::Scalar;
+#endif
+	}();
+	return best;
+}
+
+const char* Narrowphase::getKernelName(Kernel kernel) {
+	switch (kernel) {
+	case Kernel::SSE2: return "SSE2";
+	case Kernel::AVX2: return "AVX2";
+	case Kernel::AVX512: return "AVX-512";
+	default: return "scalar";
+	}
+}
+
+Narrowphase::Narrowphase() : kernel{ getBestKernel() }, sphereBox(chunkSize) {
+	for (Bucket* bucket : { &boxBox, &sphereSphere, &boxSphere }) {
+		bucket->pairs.resize(chunkSize);
+		bucket->storage.resize(12 * laneStride);
+	}
+}
+
+#if HAS_SSE2
+//4 shapes at a time the gather stores whole vectors instead of one float per lane. each shape is read as two
+//overlapping vectors from its center on, transposed, so lane k of the transposed rows is the pairs' value k
+static_assert(offsetof(AABB, halfExtent) == offsetof(AABB, center) + 12 && offsetof(BoundingSphere, radius) == offsetof(BoundingSphere, center) + 12, "shapes are read as vectors from their center");
+
+static inline void gatherBoxes(const AABB* const boxes[4], float* const* lanes, size_t n) {
+	__m128 center[4], extent[4];
+	for (int j = 0; j < 4; j++) {
+		center[j] = _mm_loadu_ps(&boxes[j]->center.x); //center, first half extent
+		extent[j] = _mm_loadu_ps(&boxes[j]->center.z); //last center, half extent
+	}
+	_MM_TRANSPOSE4_PS(center[0], center[1], center[2], center[3]);
+	_MM_TRANSPOSE4_PS(extent[0], extent[1], extent[2], extent[3]);
+	for (int k = 0; k < 3; k++) {
+		_mm_storeu_ps(lanes[k] + n, _mm_sub_ps(center[k], extent[1 + k]));
+		_mm_storeu_ps(lanes[3 + k] + n, _mm_add_ps(center[k], extent[1 + k]));
+	}
+}
+
+static inline void gatherSpheres(const BoundingSphere* const spheres[4], float* const* lanes, size_t n) {
+	__m128 rows[4];
+	for (int j = 0; j < 4; j++) rows[j] = _mm_loadu_ps(&spheres[j]->center.x); //center, radius
+	_MM_TRANSPOSE4_PS(rows[0], rows[1], rows[2], rows[3]);
+	for (int k = 0; k < 4; k++) _mm_storeu_ps(lanes[k] + n, rows[k]);
+}
+#endif
+
+void Narrowphase::gather(const std::vector<CollisionPair>& pairs, uint32_t begin, uint32_t end) {
+	//sorted into one index list per combination first, so the loops gathering the shapes never branch on the type
+	uint32_t* lists[4] = { boxBox.pairs.data(), sphereBox.data(), boxSphere.pairs.data(), sphereSphere.pairs.data() };
+	size_t counts[4] = { 0, 0, 0, 0 };
+	for (uint32_t i = begin; i < end; i++) {
+		int combination = (pairs[i].first.second->getType() == BoundType::Sphere) | ((pairs[i].second.second->getType() == BoundType::Sphere) << 1);
+		lists[combination][counts[combination]++] = i;
+	}
+	boxBox.count = counts[0];
+	sphereSphere.count = counts[3];
+	boxSphere.count = counts[2] + counts[1];
+	std::copy(sphereBox.begin(), sphereBox.begin() + counts[1], boxSphere.pairs.begin() + counts[2]);
+	float* lanes[12];
+	auto bind = [&lanes](Bucket& bucket) {
+		for (int k = 0; k < 12; k++) lanes[k] = bucket.lane(k);
+	};
+	bind(boxBox);
+	size_t n = 0;
+#if HAS_SSE2
+	for (; n + 4 <= boxBox.count; n += 4) {
+		const AABB* first[4];
+		const AABB* second[4];
+		for (int j = 0; j < 4; j++) {
+			const CollisionPair& pair = pairs[boxBox.pairs[n + j]];
+			first[j] = &shapeCast<AABB>(*pair.first.second);
+			second[j] = &shapeCast<AABB>(*pair.second.second);
+		}
+		gatherBoxes(first, lanes, n);
+		gatherBoxes(second, lanes + 6, n);
+	}
+#endif
+	for (; n < boxBox.count; n++) {
+		const CollisionPair& pair = pairs[boxBox.pairs[n]];
+		const AABB& first = shapeCast<AABB>(*pair.first.second);
+		const AABB& second = shapeCast<AABB>(*pair.second.second);
+		for (int k = 0; k < 3; k++) {
+			lanes[k][n] = first.center[k] - first.halfExtent[k];
+			lanes[3 + k][n] = first.center[k] + first.halfExtent[k];
+			lanes[6 + k][n] = second.center[k] - second.halfExtent[k];
+			lanes[9 + k][n] = second.center[k] + second.halfExtent[k];
+		}
+	}
+	bind(sphereSphere);
+	n = 0;
+#if HAS_SSE2
+	for (; n + 4 <= sphereSphere.count; n += 4) {
+		const BoundingSphere* first[4];
+		const BoundingSphere* second[4];
+		for (int j = 0; j < 4; j++) {
+			const CollisionPair& pair = pairs[sphereSphere.pairs[n + j]];
+			first[j] = &shapeCast<BoundingSphere>(*pair.first.second);
+			second[j] = &shapeCast<BoundingSphere>(*pair.second.second);
+		}
+		gatherSpheres(first, lanes, n);
+		gatherSpheres(second, lanes + 4, n);
+	}
+#endif
+	for (; n < sphereSphere.count; n++) {
+		const CollisionPair& pair = pairs[sphereSphere.pairs[n]];
+		const BoundingSphere& first = shapeCast<BoundingSphere>(*pair.first.second);
+		const BoundingSphere& second = shapeCast<BoundingSphere>(*pair.second.second);
+		for (int k = 0; k < 3; k++) {
+			lanes[k][n] = first.center[k];
+			lanes[4 + k][n] = second.center[k];
+		}
+		lanes[3][n] = first.radius;
+		lanes[7][n] = second.radius;
+	}
+	bind(boxSphere);
+	n = 0;
+#if HAS_SSE2
+	for (; n + 4 <= boxSphere.count; n += 4) {
+		const AABB* boxes[4];
+		const BoundingSphere* spheres[4];
+		for (int j = 0; j < 4; j++) {
+			const CollisionPair& pair = pairs[boxSphere.pairs[n + j]];
+			bool swapped = n + j >= counts[2];
+			boxes[j] = &shapeCast<AABB>(*(swapped ? pair.second.second : pair.first.second));
+			spheres[j] = &shapeCast<BoundingSphere>(*(swapped ? pair.first.second : pair.second.second));
+		}
+		gatherBoxes(boxes, lanes, n);
+		gatherSpheres(spheres, lanes + 6, n);
+	}
+#endif
+	for (; n < boxSphere.count; n++) {
+		const CollisionPair& pair = pairs[boxSphere.pairs[n]];
+		bool swapped = n >= counts[2];
+		const AABB& box = shapeCast<AABB>(*(swapped ? pair.second.second : pair.first.second));
+		const BoundingSphere& sphere = shapeCast<BoundingSphere>(*(swapped ? pair.first.second : pair.second.second));
+		for (int k = 0; k < 3; k++) {
+			lanes[k][n] = box.center[k] - box.halfExtent[k];
+			lanes[3 + k][n] = box.center[k] + box.halfExtent[k];
+			lanes[6 + k][n] = sphere.center[k];
+		}
+		lanes[9][n] = sphere.radius;
+	}
+	//whole vectors for the widest kernel, the padding lanes are zeros and masked off when hits are written
+	for (Bucket* bucket : { &boxBox, &sphereSphere, &boxSphere }) {
+		size_t padded = (bucket->count + maxLanes - 1) / maxLanes * maxLanes;
+		for (int k = 0; k < 12; k++) std::fill(bucket->lane(k) + bucket->count, bucket->lane(k) + padded, 0.0f);
+	}
+}
+
+void Narrowphase::generateContacts(const std::vector<CollisionPair>& pairs, const std::vector<uint64_t>& hits, std::vector<ContactManifold>& contacts) {
+	contacts.resize(pairs.size());
+	for (size_t word = 0; word < hits.size(); word++) {
+		size_t first = word * 64;
+		size_t count = std::min<size_t>(pairs.size() - first, 64);
+		for (size_t i = first; i < first + count; i++) contacts[i].pointCount = 0;
+		//most words are empty or nearly so, only the set bits are visited
+		for (uint64_t bits = hits[word]; bits; bits &= bits - 1) {
+			size_t i = first + lowestBit(bits);
+			const CollisionPair& pair = pairs[i];
+			pair.first.second->contact(*pair.second.second, contacts[i]);
+		}
+	}
+}
+
+void Narrowphase::test(const std::vector<CollisionPair>& pairs, std::vector<uint64_t>& hits) {
+	hits.assign((pairs.size() + 63) / 64, 0);
+	using KernelFunc = void(*)(const Bucket&, uint64_t*);
+	KernelFunc kernels[3] = { boxBoxScalar, sphereSphereScalar, boxSphereScalar };
+#if HAS_SSE2
+	switch (kernel) {
+	case Kernel::SSE2:
+		kernels[0] = boxBoxSSE2;
+		kernels[1] = sphereSphereSSE2;
+		kernels[2] = boxSphereSSE2;
+		break;
+	case Kernel::AVX2:
+		kernels[0] = boxBoxAVX2;
+		kernels[1] = sphereSphereAVX2;
+		kernels[2] = boxSphereAVX2;
+		break;
+	case Kernel::AVX512:
+		kernels[0] = boxBoxAVX512;
+		kernels[1] = sphereSphereAVX512;
+		kernels[2] = boxSphereAVX512;
+		break;
+	default:
+		break;
+	}
+#endif
+	for (size_t begin = 0; begin < pairs.size(); begin += chunkSize) {
+		gather(pairs, static_cast<uint32_t>(begin), static_cast<uint32_t>(std::min(pairs.size(), begin + chunkSize)));
+		kernels[0](boxBox, hits.data());
+		kernels[1](sphereSphere, hits.data());
+		kernels[2](boxSphere, hits.data());
+	}
+}
@@ -0,0 +1,45 @@
+#pragma once
+#include "scene.h"
+
+//exact tests for a whole frame of broadphase pairs at once. pairs are bucketed by shape combination, their
+//bounds gathered into structure of arrays lanes and tested 4 (SSE2), 8 (AVX2) or 16 (AVX-512) at a time,
+//whichever is the widest the CPU supports. every kernel does the same float operations in the same order as
+//the scalar tests in collision.cpp, so they all agree with BoundingVolume::intersect bit for bit
+class Narrowphase {
+public:
+	enum class Kernel { Scalar, SSE2, AVX2, AVX512 };
+	Narrowphase();
+	static Kernel getBestKernel(); //checked once
+	static const char* getKernelName(Kernel kernel);
+	Kernel getKernel() const { return kernel; }
+	void setKernel(Kernel kernel) { this->kernel = std::min(kernel, getBestKernel()); }
+	//bit i of hits is set when pairs[i] overlaps, hits is resized to pairs.size() bits rounded up to whole words
+	void test(const std::vector<CollisionPair>& pairs, std::vector<uint64_t>& hits);
+	static bool isHit(const std::vector<uint64_t>& hits, size_t pair) { return (hits[pair >> 6] >> (pair & 63)) & 1; }
+	//contacts[i] gets the manifold of pairs[i], pointCount 0 where test found no hit. contacts is only ever
+	//resized, so once it has grown to a frame's pairs this doesn't allocate
+	static void generateContacts(const std::vector<CollisionPair>& pairs, const std::vector<uint64_t>& hits, std::vector<ContactManifold>& contacts);
+	static constexpr uint32_t maxLanes = 16;
+	static constexpr uint32_t chunkSize = 1024; //pairs gathered and tested at a time, so the lanes stay in cache in between
+	//lanes sit in one block a cache line more than 4 KB apart. a whole 4 KB apart they would share their L1 sets
+	//and the gather's stores would alias the shape loads
+	static constexpr uint32_t laneStride = chunkSize + 16;
+	//one shape combination, lane(i)[j] is value i of the j-th pair in it. padded with zeros to whole vectors
+	struct Bucket {
+		std::vector<uint32_t> pairs; //where each lane's pair sits in the tested list
+		std::vector<float> storage;
+		size_t count = 0;
+		size_t size() const { return count; }
+		float* lane(int i) { return storage.data() + i * laneStride; }
+		const float* lane(int i) const { return storage.data() + i * laneStride; }
+	};
+private:
+	Kernel kernel;
+	//box-box: first min, first max, second min, second max. sphere-sphere: first center and radius, second
+	//center and radius. box-sphere: box min, box max, sphere center and radius
+	Bucket boxBox;
+	Bucket sphereSphere;
+	Bucket boxSphere;
+	std::vector<uint32_t> sphereBox; //box-sphere pairs with the sphere first, gathered the other way round
+	void gather(const std::vector<CollisionPair>& pairs, uint32_t begin, uint32_t end);
+};
@@ -0,0 +1,321 @@
+#include "octree.h"
+#include "jobs.h"
+#include <algorithm>
+#include <cmath>
+
+static inline bool boxesOverlap(const glm::vec3& firstMin, const glm::vec3& firstMax, const glm::vec3& secondMin, const glm::vec3& secondMax) {
+	if (firstMin.x > secondMax.x || secondMin.x > firstMax.x) return false;
+	if (firstMin.y > secondMax.y || secondMin.y > firstMax.y) return false;
+	if (firstMin.z > secondMax.z || secondMin.z > firstMax.z) return false;
+	return true;
+}
+
+LooseOctree::LooseOctree(float worldSize, uint32_t maxDepth) : worldSize{ worldSize }, maxDepth{ std::min(maxDepth, 20u) } {
+	nodes.emplace_back();
+	Node& rootNode = nodes[root];
+	rootNode.halfSize = 0.5f * worldSize;
+	rootNode.looseMin = glm::vec3(-worldSize);
+	rootNode.looseMax = glm::vec3(worldSize);
+}
+
+ProxyHandle LooseOctree::insert(uint32_t entityIndex, BoundingVolume* boundingVolume) {
+	assert(boundingVolume);
+	uint32_t slot;
+	if (!freeProxies.empty()) {
+		slot = freeProxies.back();
+		freeProxies.pop_back();
+	}
+	else {
+		slot = static_cast<uint32_t>(proxies.size());
+		proxies.emplace_back();
+	}
+	Proxy& proxy = proxies[slot];
+	proxy.index = entityIndex;
+	proxy.boundingVolume = boundingVolume;
+	proxy.min = boundingVolume->getCenter() - boundingVolume->getHalfExtent();
+	proxy.max = boundingVolume->getCenter() + boundingVolume->getHalfExtent();
+	locate(proxy.min, proxy.max, proxy.depth, proxy.cell);
+	link(slot, findNode(proxy.depth, proxy.cell));
+	return slot;
+}
+
+bool LooseOctree::remove(ProxyHandle proxy) {
+	if (proxy >= proxies.size() || proxies[proxy].index == UINT32_MAX) return false;
+	unlink(proxy);
+	proxies[proxy].index = UINT32_MAX;
+	proxies[proxy].boundingVolume = nullptr;
+	freeProxies.push_back(proxy);
+	return true;
+}
+
+bool LooseOctree::update(ProxyHandle proxy) {
+	if (proxy >= proxies.size() || proxies[proxy].index == UINT32_MAX) return false;
+	Proxy& moved = proxies[proxy];
+	moved.min = moved.boundingVolume->getCenter() - moved.boundingVolume->getHalfExtent();
+	moved.max = moved.boundingVolume->getCenter() + moved.boundingVolume->getHalfExtent();
+	uint32_t depth;
+	glm::uvec3 cell;
+	locate(moved.min, moved.max, depth, cell);
+	if (depth == moved.depth && cell == moved.cell) return true; //common case, the center is still in the same cell
+	//unlinked first, it may free nodes the new path would otherwise hang under
+	unlink(proxy);
+	moved.depth = depth;
+	moved.cell = cell;
+	link(proxy, findNode(depth, cell));
+	return true;
+}
+
+void LooseOctree::locate(const glm::vec3& min, const glm::vec3& max, uint32_t& depth, glm::uvec3& cell) const {
+	glm::vec3 size = max - min;
+	float halfExtent = 0.5f * std::max(size.x, std::max(size.y, size.z));
+	//cells on depth d are worldSize / 2^d wide and a box fits with a half extent of at most half a cell,
+	//so the deepest fit is floor(log2(worldSize / halfExtent)) - 1
+	int fit = halfExtent > 0.0f ? std::ilogb(worldSize / halfExtent) - 1 : static_cast<int>(maxDepth);
+	depth = static_cast<uint32_t>(std::min(std::max(fit, 0), static_cast<int>(maxDepth)));
+	float cells = static_cast<float>(1u << depth);
+	glm::vec3 coord = glm::floor(((min + max) * 0.5f + glm::vec3(0.5f * worldSize)) * (cells / worldSize));
+	if (coord.x < 0.0f || coord.y < 0.0f || coord.z < 0.0f || coord.x >= cells || coord.y >= cells || coord.z >= cells) {
+		depth = 0; //outside the world, the root takes it
+		cell = glm::uvec3(0);
+		return;
+	}
+	cell = glm::uvec3(static_cast<uint32_t>(coord.x), static_cast<uint32_t>(coord.y), static_cast<uint32_t>(coord.z));
+}
+
+uint32_t LooseOctree::findNode(uint32_t depth, const glm::uvec3& cell) {
+	uint32_t node = root;
+	for (uint32_t level = depth; level-- > 0;) {
+		int child = ((cell.x >> level) & 1) | (((cell.y >> level) & 1) << 1) | (((cell.z >> level) & 1) << 2);
+		if (nodes[node].children[child] == nullNode) {
+			uint32_t added = allocateNode(node, child);
+			nodes[node].children[child] = added;
+		}
+		node = nodes[node].children[child];
+	}
+	return node;
+}
+
+uint32_t LooseOctree::allocateNode(uint32_t parent, int child) {
+	uint32_t node;
+	if (freeList == nullNode) {
+		node = static_cast<uint32_t>(nodes.size());
+		nodes.emplace_back();
+	}
+	else {
+		node = freeList;
+		freeList = nodes[node].parent;
+		nodes[node] = Node{};
+	}
+	Node& added = nodes[node];
+	const Node& up = nodes[parent];
+	added.parent = parent;
+	added.halfSize = 0.5f * up.halfSize;
+	added.center = up.center + glm::vec3(child & 1 ? added.halfSize : -added.halfSize, child & 2 ? added.halfSize : -added.halfSize, child & 4 ? added.halfSize : -added.halfSize);
+	//a hair over twice the cell, rounding in the cell index mustn't leave a box poking out
+	glm::vec3 loose(2.002f * added.halfSize);
+	added.looseMin = added.center - loose;
+	added.looseMax = added.center + loose;
+	return node;
+}
+
+void LooseOctree::link(uint32_t slot, uint32_t node) {
+	Proxy& proxy = proxies[slot];
+	proxy.node = node;
+	proxy.prev = UINT32_MAX;
+	proxy.next = nodes[node].firstProxy;
+	if (proxy.next != UINT32_MAX) proxies[proxy.next].prev = slot;
+	nodes[node].firstProxy = slot;
+	for (uint32_t up = node; up != nullNode; up = nodes[up].parent) nodes[up].count++;
+}
+
+void LooseOctree::unlink(uint32_t slot) {
+	Proxy& proxy = proxies[slot];
+	if (proxy.prev != UINT32_MAX) proxies[proxy.prev].next = proxy.next;
+	else nodes[proxy.node].firstProxy = proxy.next;
+	if (proxy.next != UINT32_MAX) proxies[proxy.next].prev = proxy.prev;
+	//every node but the root holds something in or under it, so emptied ones go back to the pool on the way up
+	for (uint32_t node = proxy.node; node != nullNode;) {
+		uint32_t parent = nodes[node].parent;
+		if (--nodes[node].count == 0 && node != root) {
+			uint32_t* children = nodes[parent].children;
+			*std::find(children, children + 8, node) = nullNode;
+			nodes[node].parent = freeList;
+			freeList = node;
+		}
+		node = parent;
+	}
+	proxy.node = nullNode;
+}
+
+template<typename NodeTest, typename Func>
+void LooseOctree::query(NodeTest nodeTest, Func func) const {
+	uint32_t stack[maxStackSize];
+	int top = 0;
+	stack[top++] = root;
+	while (top > 0) {
+		uint32_t nodeIndex = stack[--top];
+		const Node& node = nodes[nodeIndex];
+		if (nodeIndex != root && !nodeTest(node.looseMin, node.looseMax)) continue;
+		for (uint32_t slot = node.firstProxy; slot != UINT32_MAX; slot = proxies[slot].next) func(slot, proxies[slot]);
+		for (uint32_t child : node.children) {
+			if (child == nullNode) continue;
+			assert(top < maxStackSize);
+			stack[top++] = child;
+		}
+	}
+}
+
+void LooseOctree::queryRegion(const glm::vec3& min, const glm::vec3& max, std::vector<BoundingVolumePair>& out) const {
+	auto overlaps = [&min, &max](const glm::vec3& boxMin, const glm::vec3& boxMax) {
+		return boxesOverlap(min, max, boxMin, boxMax);
+	};
+	query(overlaps, [&](uint32_t, const Proxy& proxy) {
+		if (overlaps(proxy.min, proxy.max)) out.push_back(BoundingVolumePair{ proxy.index, proxy.boundingVolume });
+	});
+}
+
+void LooseOctree::querySphere(const glm::vec3& center, float radius, std::vector<BoundingVolumePair>& out) const {
+	auto touches = [&center, radius](const glm::vec3& boxMin, const glm::vec3& boxMax) {
+		glm::vec3 d = glm::max(boxMin - center, glm::vec3(0.0f)) + glm::max(center - boxMax, glm::vec3(0.0f));
+		return glm::dot(d, d) <= radius * radius;
+	};
+	query(touches, [&](uint32_t, const Proxy& proxy) {
+		if (touches(proxy.min, proxy.max)) out.push_back(BoundingVolumePair{ proxy.index, proxy.boundingVolume });
+	});
+}
+
+void LooseOctree::queryFrustum(const Frustum& frustum, std::vector<BoundingVolumePair>& out) const {
+	uint32_t stack[maxStackSize];
+	bool inside[maxStackSize];
+	int top = 0;
+	stack[top] = root;
+	inside[top++] = false;
+	while (top > 0) {
+		top--;
+		uint32_t nodeIndex = stack[top];
+		bool nodeInside = inside[top];
+		const Node& node = nodes[nodeIndex];
+		if (!nodeInside && nodeIndex != root) {
+			Frustum::Result result = frustum.test(node.looseMin, node.looseMax);
+			if (result == Frustum::Result::Outside) continue;
+			nodeInside = result == Frustum::Result::Inside;
+		}
+		for (uint32_t slot = node.firstProxy; slot != UINT32_MAX; slot = proxies[slot].next) {
+			const Proxy& proxy = proxies[slot];
+			if (nodeInside || frustum.test(proxy.min, proxy.max) != Frustum::Result::Outside) out.push_back(BoundingVolumePair{ proxy.index, proxy.boundingVolume });
+		}
+		for (uint32_t child : node.children) {
+			if (child == nullNode) continue;
+			assert(top < maxStackSize);
+			stack[top] = child;
+			inside[top++] = nodeInside;
+		}
+	}
+}
+
+void LooseOctree::getNearestObjects(ProxyHandle proxy, std::vector<BoundingVolumePair>& out) const {
+	if (proxy >= proxies.size() || proxies[proxy].index == UINT32_MAX) return;
+	const Proxy& queryProxy = proxies[proxy];
+	auto overlaps = [&queryProxy](const glm::vec3& boxMin, const glm::vec3& boxMax) {
+		return boxesOverlap(queryProxy.min, queryProxy.max, boxMin, boxMax);
+	};
+	query(overlaps, [&](uint32_t slot, const Proxy& other) {
+		if (slot != proxy && overlaps(other.min, other.max)) out.push_back(BoundingVolumePair{ other.index, other.boundingVolume });
+	});
+}
+
+bool LooseOctree::rayCast(const Ray& ray, RayHit& hit, bool anyHit) const {
+	castPacket(&ray, &hit, 1, anyHit);
+	return hit.index != UINT32_MAX;
+}
+
+void LooseOctree::rayCastRange(const Ray* rays, RayHit* hits, size_t count, bool anyHit) const {
+	for (size_t first = 0; first < count; first += rayPacketSize) {
+		castPacket(rays + first, hits + first, static_cast<uint32_t>(std::min<size_t>(rayPacketSize, count - first)), anyHit);
+	}
+}
+
+void LooseOctree::castPacket(const Ray* rays, RayHit* hits, uint32_t count, bool anyHit) const {
+	assert(count > 0 && count <= 32);
+	for (uint32_t i = 0; i < count; i++) hits[i] = RayHit{};
+	//same as AABBTree, each stack entry carries the mask of rays that reached its parent
+	uint32_t active = count == 32 ? UINT32_MAX : (1u << count) - 1;
+	uint32_t stack[maxStackSize];
+	uint32_t masks[maxStackSize];
+	int top = 0;
+	stack[top] = root;
+	masks[top++] = active;
+	const Ray& lead = rays[0];
+	while (top > 0) {
+		top--;
+		uint32_t nodeIndex = stack[top];
+		const Node& node = nodes[nodeIndex];
+		uint32_t reached = masks[top] & active;
+		float enter;
+		if (nodeIndex != root) {
+			for (uint32_t i = 0; i < count; i++) {
+				if ((reached & (1u << i)) && !rays[i].clip(node.looseMin, node.looseMax, std::min(hits[i].distance, rays[i].maxDistance), enter)) reached &= ~(1u << i);
+			}
+			if (reached == 0) continue;
+		}
+		for (uint32_t slot = node.firstProxy; slot != UINT32_MAX; slot = proxies[slot].next) {
+			const Proxy& proxy = proxies[slot];
+			for (uint32_t i = 0; i < count; i++) {
+				if (!(reached & (1u << i)) || !rays[i].clip(proxy.min, proxy.max, std::min(hits[i].distance, rays[i].maxDistance), enter)) continue;
+				if (closerHit(rays[i], proxy.index, proxy.boundingVolume, hits[i]) && anyHit) {
+					active &= ~(1u << i);
+					reached &= ~(1u << i);
+				}
+			}
+		}
+		if (active == 0) return;
+		if (reached == 0) continue;
+		//children furthest along the first ray go on the stack first, so the nearest is visited next
+		uint32_t order[8];
+		float along[8];
+		int children = 0;
+		for (uint32_t child : node.children) {
+			if (child == nullNode) continue;
+			float distance = glm::dot(nodes[child].center, lead.direction);
+			int j = children++;
+			for (; j > 0 && along[j - 1] < distance; j--) {
+				order[j] = order[j - 1];
+				along[j] = along[j - 1];
+			}
+			order[j] = child;
+			along[j] = distance;
+		}
+		assert(top + children <= maxStackSize);
+		for (int j = 0; j < children; j++) {
+			stack[top] = order[j];
+			masks[top++] = reached;
+		}
+	}
+}
+
+void LooseOctree::getCollisionPairs(std::vector<CollisionPair>& out) const {
+	collectPairs(0, static_cast<uint32_t>(proxies.size()), out);
+}
+
+void LooseOctree::getCollisionPairs(std::vector<CollisionPair>& out, JobSystem& jobs, WorkerPairs& workerPairs) const {
+	clearWorkerPairs(jobs, workerPairs);
+	jobs.parallelFor(static_cast<uint32_t>(proxies.size()), 256, [this, &workerPairs](uint32_t begin, uint32_t end, uint32_t worker) {
+		collectPairs(begin, end, workerPairs[worker]);
+	});
+	mergeWorkerPairs(out, jobs, workerPairs);
+}
+
+void LooseOctree::collectPairs(uint32_t begin, uint32_t end, std::vector<CollisionPair>& out) const {
+	for (uint32_t slot = begin; slot < end; slot++) {
+		const Proxy& first = proxies[slot];
+		if (first.index == UINT32_MAX) continue;
+		auto overlaps = [&first](const glm::vec3& boxMin, const glm::vec3& boxMax) {
+			return boxesOverlap(first.min, first.max, boxMin, boxMax);
+		};
+		query(overlaps, [&](uint32_t otherSlot, const Proxy& second) {
+			//every pair is seen from both proxies, keep the one found from the lower slot
+			if (otherSlot <= slot || !overlaps(second.min, second.max)) return;
+			out.push_back(CollisionPair{ BoundingVolumePair{ first.index, first.boundingVolume }, BoundingVolumePair{ second.index, second.boundingVolume } });
+		});
+	}
+}
@@ -0,0 +1,67 @@
+#pragma once
+#include "scene.h"
+
+//loose octree over a cube of octreeWorldSize centered on the origin. every node's bounds are twice its cell,
+//so a box fits the node holding its center on the level whose cells are at least as wide as the box, and
+//that level comes straight from the box size. boxes outside the world stay in the root, which queries never
+//cull. nodes come from a pool and go back to it once nothing lives in or under them
+//handles are slots in proxies
+class LooseOctree : public SpatialPartition {
+public:
+	LooseOctree(float worldSize = octreeWorldSize, uint32_t maxDepth = octreeMaxDepth);
+	void getNearestObjects(ProxyHandle proxy, std::vector<BoundingVolumePair>& out) const override;
+	//nodes wholly inside hand over their subtree untested
+	void queryFrustum(const Frustum& frustum, std::vector<BoundingVolumePair>& out) const override;
+	bool rayCast(const Ray& ray, RayHit& hit, bool anyHit = false) const override;
+	ProxyHandle insert(uint32_t entityIndex, BoundingVolume* boundingVolume) override;
+	bool remove(ProxyHandle proxy) override;
+	bool update(ProxyHandle proxy) override;
+	void getCollisionPairs(std::vector<CollisionPair>& out) const override;
+	void getCollisionPairs(std::vector<CollisionPair>& out, JobSystem& jobs, WorkerPairs& workerPairs) const override;
+	//everything whose box overlaps [min, max]
+	void queryRegion(const glm::vec3& min, const glm::vec3& max, std::vector<BoundingVolumePair>& out) const;
+	//everything whose box the sphere touches
+	void querySphere(const glm::vec3& center, float radius, std::vector<BoundingVolumePair>& out) const;
+private:
+	static constexpr uint32_t nullNode = UINT32_MAX;
+	static constexpr uint32_t root = 0;
+	static constexpr int maxStackSize = 256;
+	struct Node {
+		glm::vec3 looseMin{ 0.0f };
+		glm::vec3 looseMax{ 0.0f };
+		glm::vec3 center{ 0.0f };
+		float halfSize = 0.0f; //of the cell
+		uint32_t children[8] = { nullNode, nullNode, nullNode, nullNode, nullNode, nullNode, nullNode, nullNode };
+		uint32_t parent = nullNode; //doubles as the free list link
+		uint32_t firstProxy = UINT32_MAX;
+		uint32_t count = 0; //proxies in this node and below
+	};
+	struct Proxy {
+		uint32_t index = UINT32_MAX; //entity index, UINT32_MAX while the slot is free
+		BoundingVolume* boundingVolume = nullptr;
+		glm::vec3 min{ 0.0f };
+		glm::vec3 max{ 0.0f };
+		uint32_t node = nullNode;
+		uint32_t depth = 0; //where the box belongs, depth 0 also for boxes outside the world
+		glm::uvec3 cell{ 0 };
+		uint32_t next = UINT32_MAX; //list of the proxies in the same node
+		uint32_t prev = UINT32_MAX;
+	};
+	float worldSize;
+	uint32_t maxDepth;
+	std::vector<Node> nodes;
+	uint32_t freeList = nullNode;
+	std::vector<Proxy> proxies;
+	std::vector<uint32_t> freeProxies;
+	uint32_t allocateNode(uint32_t parent, int child);
+	void locate(const glm::vec3& min, const glm::vec3& max, uint32_t& depth, glm::uvec3& cell) const;
+	uint32_t findNode(uint32_t depth, const glm::uvec3& cell); //creates the path down to it as needed
+	void link(uint32_t slot, uint32_t node);
+	void unlink(uint32_t slot);
+	template<typename NodeTest, typename Func>
+	void query(NodeTest nodeTest, Func func) const;
+	void rayCastRange(const Ray* rays, RayHit* hits, size_t count, bool anyHit) const override;
+	//up to 32 rays down the tree together, a node is loaded once for every ray that reaches it
+	void castPacket(const Ray* rays, RayHit* hits, uint32_t count, bool anyHit) const;
+	void collectPairs(uint32_t begin, uint32_t end, std::vector<CollisionPair>& out) const; //pairs found from proxies [begin, end)
+};
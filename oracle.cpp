@@ -0,0 +1,78 @@
+#include "oracle.h"
+#include <algorithm>
+
+static inline bool boundsOverlap(BoundingVolume* first, BoundingVolume* second) {
+	glm::vec3 first_min = first->getCenter() - first->getHalfExtent();
+	glm::vec3 first_max = first->getCenter() + first->getHalfExtent();
+	glm::vec3 second_min = second->getCenter() - second->getHalfExtent();
+	glm::vec3 second_max = second->getCenter() + second->getHalfExtent();
+	if (first_min.x > second_max.x || second_min.x > first_max.x) return false;
+	if (first_min.y > second_max.y || second_min.y > first_max.y) return false;
+	if (first_min.z > second_max.z || second_min.z > first_max.z) return false;
+	return true;
+}
+
+static inline std::pair<uint32_t, uint32_t> orderedPair(uint32_t first, uint32_t second) {
+	return std::pair<uint32_t, uint32_t>(std::min(first, second), std::max(first, second));
+}
+
+bool BroadphaseOracle::check(EntityManager& entityManager, const std::vector<CollisionPair>& pairs) {
+	//rebuilt from scratch every check so the reference can't drift from what the entity manager holds
+	reference.clear();
+	auto addBounds = [this](const auto& pool, bool isStatic) {
+		for (uint32_t slot = 0; slot < pool.size(); slot++) {
+			if (pool.getOwner(slot) == UINT32_MAX) continue;
+			const auto& shape = pool[slot];
+			reference.push_back(Bounds{ shape.getCenter() - shape.getHalfExtent(), shape.getCenter() + shape.getHalfExtent(), pool.getOwner(slot), isStatic });
+		}
+	};
+	addBounds(entityManager.aabbs, true);
+	addBounds(entityManager.boundingSpheres, false);
+	std::sort(reference.begin(), reference.end(), [](const Bounds& first, const Bounds& second) { return first.min.x < second.min.x; });
+	auto isStatic = [&entityManager](uint32_t index) {
+		auto it = entityManager.gameEntities.find(index);
+		return it != entityManager.gameEntities.end() && it->second.getBoundType() == BoundType::AABB;
+	};
+	//sweep along x, every box is only tested against the ones starting before it ends
+	expected.clear();
+	for (size_t i = 0; i < reference.size(); i++) {
+		const Bounds& first = reference[i];
+		for (size_t j = i + 1; j < reference.size() && reference[j].min.x <= first.max.x; j++) {
+			const Bounds& second = reference[j];
+			if (ignoreStaticPairs && first.isStatic && second.isStatic) continue;
+			if (first.min.y > second.max.y || second.min.y > first.max.y) continue;
+			if (first.min.z > second.max.z || second.min.z > first.max.z) continue;
+			expected.insert(orderedPair(first.index, second.index));
+		}
+	}
+	found.clear();
+	missing.clear();
+	extra.clear();
+	for (const CollisionPair& pair : pairs) {
+		std::pair<uint32_t, uint32_t> key = orderedPair(pair.first.first, pair.second.first);
+		bool firstSeen = found.insert(key).second;
+		if (firstSeen && expected.find(key) != expected.end()) continue;
+		//statics are allowed to skip each other, not required to, so overlapping ones reported once are fine too
+		if (firstSeen && ignoreStaticPairs && isStatic(key.first) && isStatic(key.second) && boundsOverlap(pair.first.second, pair.second.second)) continue;
+		extra.push_back(key);
+	}
+	for (const std::pair<uint32_t, uint32_t>& key : expected) {
+		if (found.find(key) == found.end()) missing.push_back(key);
+	}
+	std::sort(missing.begin(), missing.end());
+	std::sort(extra.begin(), extra.end());
+	return missing.empty() && extra.empty();
+}
+
+void BroadphaseOracle::report(std::ostream& out, size_t maxListed) const {
+	out << "Broadphase mismatch: " << missing.size() << " missing, " << extra.size() << " extra" << std::endl;
+	auto list = [&out, maxListed](const char* name, const std::vector<std::pair<uint32_t, uint32_t>>& pairs) {
+		if (pairs.empty()) return;
+		out << "  " << name << ":";
+		for (size_t i = 0; i < pairs.size() && i < maxListed; i++) out << " (" << pairs[i].first << ", " << pairs[i].second << ")";
+		if (pairs.size() > maxListed) out << " ...";
+		out << std::endl;
+	};
+	list("missing", missing);
+	list("extra", extra);
+}
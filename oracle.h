@@ -0,0 +1,30 @@
+#pragma once
+#include "scene.h"
+#include <vector>
+#include <ostream>
+
+//checks a partition's pairs against a plain sweep over the same bounding volumes, rebuilt and sorted on every
+//check so only run it on sampled frames. a pair is expected whenever the two boxes overlap, pairs of two statics
+//may be left out
+class BroadphaseOracle {
+public:
+	//pairs is what the active partition reported for the current state of entityManager, returns true if they match
+	bool check(EntityManager& entityManager, const std::vector<CollisionPair>& pairs);
+	//entity id pairs (lower id first) from the last check
+	const std::vector<std::pair<uint32_t, uint32_t>>& getMissing() const { return missing; }
+	const std::vector<std::pair<uint32_t, uint32_t>>& getExtra() const { return extra; } //not overlapping or reported twice
+	void report(std::ostream& out, size_t maxListed = 16) const;
+	bool ignoreStaticPairs = true; //statics are allowed to skip each other, see SpatialPartition::insertStatic
+private:
+	struct Bounds {
+		glm::vec3 min;
+		glm::vec3 max;
+		uint32_t index;
+		bool isStatic;
+	};
+	std::vector<Bounds> reference; //sorted by min x
+	UnorderedPairSet expected;
+	UnorderedPairSet found;
+	std::vector<std::pair<uint32_t, uint32_t>> missing;
+	std::vector<std::pair<uint32_t, uint32_t>> extra;
+};
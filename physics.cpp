@@ -4,29 +4,15 @@
 void PhysicsManager::runPhysics(EntityManager& entityManager) {
 	//collision
 	static UnorderedPairSet collisionsFound; //called every frame anyway so made static to avoid reallocating
+	static std::vector<BoundingVolumePair> nearestObjects;
 	collisionsFound.clear();
+	entityManager.spatialPartition.flushUpdates();
 	for (auto& entity : entityManager.gameEntities) {
 		GameEntity& gameEntity = entity.second;
-		std::vector<BoundingVolumePair> nearestObjects;
-		BoundingVolume* boundingVolume = nullptr;
-		switch (gameEntity.getBoundType()) {
-		case BoundType::AABB: 
-			{
-				AABB& aabb = entityManager.aabbs.at(gameEntity.getIndex());
-				boundingVolume = &aabb;
-				BoundingVolumePair pair = { gameEntity.getIndex(), boundingVolume };
-				nearestObjects = entityManager.spatialPartition.getNearestObjects(pair);
-			}
-			break;
-		case BoundType::Sphere: 
-			{
-				BoundingSphere& boundingSphere = entityManager.boundingSpheres.at(gameEntity.getIndex());
-				boundingVolume = &boundingSphere;
-				BoundingVolumePair pair = { gameEntity.getIndex(), boundingVolume };
-				nearestObjects = entityManager.spatialPartition.getNearestObjects(pair);
-			}
-			break;
-		}
+		nearestObjects.clear();
+		BoundingVolume* boundingVolume = entityManager.getBoundingVolume(gameEntity);
+		if (!boundingVolume) continue;
+		entityManager.spatialPartition.getNearestObjects(gameEntity.getProxy(), nearestObjects);
 		//std::cout << "Entity: " << gameEntity.getIndex() << ", Potential collisions: " << nearestObjects.size() << std::endl;
 		for (BoundingVolumePair& boundingVolumePair : nearestObjects) {
 			std::pair<uint32_t, uint32_t> collisionPair{ gameEntity.getIndex(), boundingVolumePair.first };
@@ -50,17 +36,123 @@ void PhysicsManager::runPhysics(EntityManager& entityManager) {
 }
 
 void PhysicsManager::runPhysics2(EntityManager& entityManager) {
-	UnorderedPairMap& collisionPairs = entityManager.spatialPartition.getCollisionPairs();
-	for (auto& collisionPair : collisionPairs) {
-		if (collisionPair.second.first->intersect(collisionPair.second.second)) {
+	findCollisions(entityManager);
+	markCollisions(entityManager);
+}
+
+void PhysicsManager::step(EntityManager& entityManager, float dt) {
+	if (dt <= 0.0f) return;
+	rigidBodies.integrateVelocities(dt, glm::vec3(0.0f, gravity, 0.0f));
+	findCollisions(entityManager);
+	markCollisions(entityManager);
+	Narrowphase::generateContacts(collisionPairs, hits, contacts);
+	prepareContacts(dt);
+	solveContacts();
+	rigidBodies.integratePositions(dt);
+	//resting bodies keep their place, only the moved ones go through the entity manager and the broadphase
+	movedEntities.clear();
+	movedPositions.clear();
+	for (uint32_t body = 0; body < rigidBodies.size(); body++) {
+		if (rigidBodies.velocityX[body] == 0.0f && rigidBodies.velocityY[body] == 0.0f && rigidBodies.velocityZ[body] == 0.0f) continue;
+		movedEntities.push_back(rigidBodies.entities[body]);
+		movedPositions.push_back(rigidBodies.getPosition(body));
+	}
+	entityManager.setSpherePositions(movedEntities, movedPositions);
+}
+
+uint32_t PhysicsManager::addBody(EntityManager& entityManager, uint32_t entityIndex, float inverseMass, float restitution, float friction, const glm::vec3& velocity) {
+	auto it = entityManager.gameEntities.find(entityIndex);
+	if (it == entityManager.gameEntities.end() || it->second.getBoundType() != BoundType::Sphere) return RigidBodies::nullBody;
+	return rigidBodies.add(entityIndex, it->second.getPos(), inverseMass, restitution, friction, velocity);
+}
+
+bool PhysicsManager::removeBody(uint32_t entityIndex) {
+	return rigidBodies.remove(entityIndex);
+}
+
+void PhysicsManager::findCollisions(EntityManager& entityManager) {
+	collisionPairs.clear();
+	entityManager.spatialPartition.flushUpdates(jobSystem);
+	entityManager.spatialPartition.getCollisionPairs(collisionPairs, jobSystem, workerPairs);
+	if (verifyInterval && frame % verifyInterval == 0 && !oracle.check(entityManager, collisionPairs)) {
+		std::cerr << "Frame " << frame << ": ";
+		oracle.report(std::cerr);
+	}
+	frame++;
+	narrowphase.test(collisionPairs, hits);
+}
+
+void PhysicsManager::markCollisions(EntityManager& entityManager) {
+	for (size_t i = 0; i < collisionPairs.size(); i++) {
+		if (Narrowphase::isHit(hits, i)) {
+			const CollisionPair& collisionPair = collisionPairs[i];
 			auto it = entityManager.renderables.find(collisionPair.first.first);
 			if (it != entityManager.renderables.end()) {
 				it->second.collisionOccurred = true;
 			}
-			it = entityManager.renderables.find(collisionPair.first.second);
+			it = entityManager.renderables.find(collisionPair.second.first);
 			if (it != entityManager.renderables.end()) {
 				it->second.collisionOccurred = true;
 			}
 		}
 	}
 }
+
+void PhysicsManager::prepareContacts(float dt) {
+	solverContacts.clear();
+	for (size_t i = 0; i < collisionPairs.size(); i++) {
+		const ContactManifold& manifold = contacts[i];
+		if (manifold.pointCount == 0) continue;
+		SolverContact contact;
+		contact.first = rigidBodies.find(collisionPairs[i].first.first);
+		contact.second = rigidBodies.find(collisionPairs[i].second.first);
+		float firstInverseMass = contact.first == RigidBodies::nullBody ? 0.0f : rigidBodies.inverseMass[contact.first];
+		float secondInverseMass = contact.second == RigidBodies::nullBody ? 0.0f : rigidBodies.inverseMass[contact.second];
+		contact.inverseMassSum = firstInverseMass + secondInverseMass;
+		if (contact.inverseMassSum <= 0.0f) continue; //nothing in the pair can be pushed
+		//entities without a body take on the material of the one they touch
+		float restitution = 0.0f;
+		float friction = -1.0f;
+		for (uint32_t body : { contact.first, contact.second }) {
+			if (body == RigidBodies::nullBody) continue;
+			restitution = std::max(restitution, rigidBodies.restitution[body]);
+			friction = friction < 0.0f ? rigidBodies.friction[body] : std::sqrt(friction * rigidBodies.friction[body]);
+		}
+		contact.friction = friction;
+		glm::vec3 relative = getVelocity(contact.second) - getVelocity(contact.first);
+		contact.normal = manifold.normal;
+		float approach = glm::dot(relative, contact.normal);
+		float bounce = approach < -restitutionThreshold ? -restitution * approach : 0.0f;
+		float push = contactBaumgarte * std::max(manifold.depth - contactSlop, 0.0f) / dt;
+		contact.targetSpeed = std::max(bounce, push);
+		glm::vec3 sliding = relative - approach * contact.normal;
+		float slidingSpeed = glm::length(sliding);
+		contact.tangent = slidingSpeed > 1e-6f ? sliding / slidingSpeed : glm::vec3(0.0f);
+		contact.normalImpulse = 0.0f;
+		contact.tangentImpulse = 0.0f;
+		solverContacts.push_back(contact);
+	}
+}
+
+void PhysicsManager::solveContacts() {
+	//sequential impulses, clamping what each contact has accumulated rather than each pass's share, so later
+	//passes can take back what an earlier one overdid
+	auto applyImpulse = [this](const SolverContact& contact, const glm::vec3& impulse) {
+		if (contact.first != RigidBodies::nullBody) rigidBodies.setVelocity(contact.first, getVelocity(contact.first) - impulse * rigidBodies.inverseMass[contact.first]);
+		if (contact.second != RigidBodies::nullBody) rigidBodies.setVelocity(contact.second, getVelocity(contact.second) + impulse * rigidBodies.inverseMass[contact.second]);
+	};
+	for (uint32_t iteration = 0; iteration < solverIterations; iteration++) {
+		for (SolverContact& contact : solverContacts) {
+			glm::vec3 relative = getVelocity(contact.second) - getVelocity(contact.first);
+			float normalImpulse = std::max(contact.normalImpulse + (contact.targetSpeed - glm::dot(relative, contact.normal)) / contact.inverseMassSum, 0.0f);
+			applyImpulse(contact, (normalImpulse - contact.normalImpulse) * contact.normal);
+			contact.normalImpulse = normalImpulse;
+			//friction can hold back at most friction times what presses the pair together
+			relative = getVelocity(contact.second) - getVelocity(contact.first);
+			float maxFriction = contact.friction * contact.normalImpulse;
+			float tangentImpulse = glm::clamp(contact.tangentImpulse - glm::dot(relative, contact.tangent) / contact.inverseMassSum, -maxFriction, maxFriction);
+			applyImpulse(contact, (tangentImpulse - contact.tangentImpulse) * contact.tangent);
+			contact.tangentImpulse = tangentImpulse;
+		}
+	}
+}
@@ -1,9 +1,51 @@
 #pragma once
 #include "scene.h"
+#include "jobs.h"
+#include "oracle.h"
+#include "narrowphase.h"
+#include "rigidbody.h"
 #include <unordered_set>
 
 class PhysicsManager {
 public:
 	void runPhysics(EntityManager& entityManager);
 	void runPhysics2(EntityManager& entityManager);
+	//advances the rigid bodies by dt: gravity, broadphase and narrowphase on the current positions, contact
+	//impulses, then positions, which are written back to their entities. entities without a body are immovable
+	void step(EntityManager& entityManager, float dt);
+	//gives a sphere entity a body starting at its position. only spheres move, other entities and unknown
+	//indices get nullBody
+	uint32_t addBody(EntityManager& entityManager, uint32_t entityIndex, float inverseMass, float restitution, float friction, const glm::vec3& velocity = glm::vec3{ 0.0f });
+	//destroying an entity doesn't touch its body, whoever destroys it drops the body too. false if it had none
+	bool removeBody(uint32_t entityIndex);
+	RigidBodies rigidBodies;
+	uint32_t verifyInterval = broadphaseVerifyInterval;
+private:
+	JobSystem jobSystem;
+	WorkerPairs workerPairs;
+	Narrowphase narrowphase;
+	std::vector<uint64_t> hits;
+	std::vector<ContactManifold> contacts;
+	struct SolverContact {
+		uint32_t first; //bodies, nullBody for entities without one
+		uint32_t second;
+		glm::vec3 normal;
+		glm::vec3 tangent;
+		float targetSpeed; //separating speed along the normal the solver aims for
+		float inverseMassSum;
+		float friction;
+		float normalImpulse; //accumulated over the iterations
+		float tangentImpulse;
+	};
+	std::vector<SolverContact> solverContacts;
+	std::vector<CollisionPair> collisionPairs;
+	std::vector<uint32_t> movedEntities; //the step's write-back, handed to the entity manager in one call
+	std::vector<glm::vec3> movedPositions;
+	void findCollisions(EntityManager& entityManager); //broadphase pairs into collisionPairs, narrowphase hits into hits
+	void markCollisions(EntityManager& entityManager);
+	void prepareContacts(float dt);
+	void solveContacts();
+	glm::vec3 getVelocity(uint32_t body) const { return body == RigidBodies::nullBody ? glm::vec3(0.0f) : rigidBodies.getVelocity(body); }
+	BroadphaseOracle oracle;
+	uint64_t frame = 0;
 };
\ No newline at end of file
@@ -1,4 +1,8 @@
 #include "renderer.h"
+#include "physics.h"
+#include <assimp/Importer.hpp>
+#include <assimp/config.h>
+#include <assimp/scene.h>
 #include <assimp/postprocess.h>
 
 void Renderer::startUp(GLFWwindow* window, GLFWCallbackData* callbackData, EntityManager& entityManager) {
@@ -64,9 +68,10 @@ void Renderer::startUp(GLFWwindow* window, GLFWCallbackData* callbackData, Entit
     ImGuiIO& Imgui_io = ImGui::GetIO(); (void)Imgui_io;
 }
 
-void Renderer::shutDown(EntityManager& entityManager) {
+void Renderer::shutDown(EntityManager& entityManager, PhysicsManager& physicsManager) {
 	glFinish();
     for (uint32_t entity : entityList) {
+        physicsManager.removeBody(entity);
         entityManager.destroyEntity(entity);
     }
 	glDeleteBuffers(1, &cubeInstanceDataBuffer);
@@ -75,12 +80,17 @@ void Renderer::shutDown(EntityManager& entityManager) {
     sphereMesh.destroy();
 }
 
-void Renderer::renderFrame(GLFWwindow* window, EntityManager& entityManager, UIState& uiState) {
+void Renderer::renderFrame(GLFWwindow* window, EntityManager& entityManager, PhysicsManager& physicsManager, UIState& uiState) {
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
     std::vector<InstanceData> sphereInstanceData;
     std::vector<InstanceData> cubeInstanceData;
-    for (auto& pair : entityManager.renderables) {
-        Renderable& renderable = pair.second;
+    //only what the partition finds inside the view frustum gets instance data, is uploaded and drawn
+    visibleObjects.clear();
+    entityManager.spatialPartition.queryFrustum(Frustum(projection * view), visibleObjects);
+    for (const BoundingVolumePair& visible : visibleObjects) {
+        auto it = entityManager.renderables.find(visible.first);
+        if (it == entityManager.renderables.end()) continue;
+        Renderable& renderable = it->second;
         InstanceData instanceData;
         instanceData.model = renderable.model;
         if (renderable.collisionOccurred) {
@@ -97,8 +107,16 @@ void Renderer::renderFrame(GLFWwindow* window, EntityManager& entityManager, UIS
     //if (useBasicShader) basicShader.useProgram();
     //else posShader.useProgram();
     glBindBuffer(GL_SHADER_STORAGE_BUFFER, sphereInstanceDataBuffer);
+    if (sphereInstanceData.size() > sphereInstanceCapacity) { //generated scenes can hold far more than maxInstances
+        sphereInstanceCapacity = std::max(sphereInstanceData.size(), 2 * sphereInstanceCapacity);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, sphereInstanceCapacity * sizeof(InstanceData), NULL, GL_DYNAMIC_DRAW);
+    }
     glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sphereInstanceData.size() * sizeof(InstanceData), sphereInstanceData.data());
     glBindBuffer(GL_SHADER_STORAGE_BUFFER, cubeInstanceDataBuffer);
+    if (cubeInstanceData.size() > cubeInstanceCapacity) {
+        cubeInstanceCapacity = std::max(cubeInstanceData.size(), 2 * cubeInstanceCapacity);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, cubeInstanceCapacity * sizeof(InstanceData), NULL, GL_DYNAMIC_DRAW);
+    }
     glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, cubeInstanceData.size() * sizeof(InstanceData), cubeInstanceData.data());
     glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, sphereInstanceDataBuffer);
     glBindVertexArray(sphereMesh.vao);
@@ -167,6 +185,7 @@ void Renderer::renderFrame(GLFWwindow* window, EntityManager& entityManager, UIS
                     entityManager.setScale(currentEntityIndex, inputScale);
                 }
                 if (ImGui::Button("Remove current entity")) {
+                    physicsManager.removeBody(currentEntityIndex);
                     entityManager.destroyEntity(currentEntityIndex);
                     entityList.erase(entityList.begin() + currentEntity);
                     if (currentEntity >= entityList.size() && currentEntity > 0) {
@@ -206,6 +225,55 @@ void Renderer::renderFrame(GLFWwindow* window, EntityManager& entityManager, UIS
 	glfwSwapBuffers(window);
 }
 
+bool loadModel(Mesh& mesh, const char* modelPath, unsigned int flags) {
+    Assimp::Importer importer;
+    importer.SetPropertyInteger(AI_CONFIG_PP_SBP_REMOVE, aiPrimitiveType_POINT | aiPrimitiveType_LINE);
+    const aiScene* scene = importer.ReadFile(modelPath, flags);
+    if (!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode)
+    {
+        std::cerr << "Assimp error: " << importer.GetErrorString() << std::endl;
+        return false;
+    }
+    std::vector<glm::vec3> vertexAttributes;
+    aiMesh* ai_mesh = scene->mMeshes[0];
+    assert(scene->mNumMeshes == 1);
+    for (size_t i = 0; i < ai_mesh->mNumVertices; i++) {
+        aiVector3D pos = ai_mesh->mVertices[i];
+        vertexAttributes.push_back(glm::vec3(pos.x, pos.y, pos.z));
+        aiVector3D norm = ai_mesh->mNormals[i];
+        vertexAttributes.push_back(glm::vec3(norm.x, norm.y, norm.z));
+    }
+    GLuint vao;
+    glGenVertexArrays(1, &vao);
+    glBindVertexArray(vao);
+    GLuint vbo;
+    glGenBuffers(1, &vbo);
+    glBindBuffer(GL_ARRAY_BUFFER, vbo);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(glm::vec3) * vertexAttributes.size(), vertexAttributes.data(), GL_STATIC_DRAW);
+    std::vector<GLuint> indices;
+    for (size_t i = 0; i < ai_mesh->mNumFaces; i++) {
+        aiFace face = ai_mesh->mFaces[i];
+        for (size_t j = 0; j < face.mNumIndices; j++) {
+            indices.push_back(face.mIndices[j]);
+        }
+    }
+    mesh.numIndices = indices.size();
+    GLuint ebo;
+    glGenBuffers(1, &ebo);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(GLuint) * indices.size(), indices.data(), GL_STATIC_DRAW);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 2 * sizeof(glm::vec3), 0);
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 2 * sizeof(glm::vec3), (void*) (sizeof(glm::vec3)));
+    glBindVertexArray(0);
+    mesh.initialized = true;
+    mesh.vao = vao;
+    mesh.vbo = vbo;
+    mesh.ebo = ebo;
+    return true;
+}
+
 void framebuffer_size_callback(GLFWwindow* window, int width, int height)
 {
     glViewport(0, 0, width, height);
@@ -13,6 +13,8 @@
 #include "backends/imgui_impl_opengl3.h"
 #include <GLFW/glfw3.h>
 
+class PhysicsManager;
+
 struct InstanceData {
 	glm::mat4 model;
 	glm::vec4 color;
@@ -28,13 +30,16 @@ void APIENTRY glDebugOutput(GLenum source,
 
 void framebuffer_size_callback(GLFWwindow* window, int width, int height);
 
+bool loadModel(Mesh& mesh, const char* modelPath, unsigned int flags);
+
 class Renderer {
 public:
 	Renderer() {}
 	~Renderer() {}
 	void startUp(GLFWwindow* window, GLFWCallbackData* callbackData, EntityManager& entityManager);
-	void shutDown(EntityManager& entityManager);
+	void shutDown(EntityManager& entityManager, PhysicsManager& physicsManager);
 	void setView(const glm::mat4& view) { 
+		this->view = view;
 		if (useBasicShader) {
 			basicShader.useProgram();
 			basicShader.setMat4("view", glm::value_ptr(view));
@@ -44,7 +49,7 @@ public:
 			posShader.setMat4("view", glm::value_ptr(view));
 		}	
 	}
-	void renderFrame(GLFWwindow* window, EntityManager& entityManager, UIState& uiState);
+	void renderFrame(GLFWwindow* window, EntityManager& entityManager, PhysicsManager& physicsManager, UIState& uiState);
 	Mesh cubeMesh;
 	Mesh sphereMesh;
 	std::vector<uint32_t> entityList;
@@ -56,5 +61,9 @@ private:
 	Shader posShader;
 	GLuint cubeInstanceDataBuffer = 0;
 	GLuint sphereInstanceDataBuffer = 0;
+	size_t cubeInstanceCapacity = maxInstances;
+	size_t sphereInstanceCapacity = maxInstances;
 	glm::mat4 projection{ 1.0f };
+	glm::mat4 view{ 1.0f };
+	std::vector<BoundingVolumePair> visibleObjects; //kept between frames so the query stops allocating
 };
\ No newline at end of file
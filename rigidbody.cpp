@@ -0,0 +1,103 @@
+#include "rigidbody.h"
+#if HAS_SSE2
+#include <emmintrin.h>
+#endif
+
+uint32_t RigidBodies::add(uint32_t entityIndex, const glm::vec3& position, float inverseMass, float restitution, float friction, const glm::vec3& velocity) {
+	auto it = bodies.find(entityIndex);
+	if (it != bodies.end()) return it->second;
+	uint32_t body = static_cast<uint32_t>(entities.size());
+	entities.push_back(entityIndex);
+	positionX.push_back(position.x);
+	positionY.push_back(position.y);
+	positionZ.push_back(position.z);
+	velocityX.push_back(velocity.x);
+	velocityY.push_back(velocity.y);
+	velocityZ.push_back(velocity.z);
+	this->inverseMass.push_back(inverseMass);
+	this->restitution.push_back(restitution);
+	this->friction.push_back(friction);
+	bodies.emplace(entityIndex, body);
+	return body;
+}
+
+bool RigidBodies::remove(uint32_t entityIndex) {
+	auto it = bodies.find(entityIndex);
+	if (it == bodies.end()) return false;
+	uint32_t body = it->second;
+	uint32_t last = static_cast<uint32_t>(entities.size() - 1);
+	bodies.erase(it);
+	if (body != last) {
+		entities[body] = entities[last];
+		bodies[entities[body]] = body;
+	}
+	entities.pop_back();
+	for (std::vector<float>* component : { &positionX, &positionY, &positionZ, &velocityX, &velocityY, &velocityZ, &inverseMass, &restitution, &friction }) {
+		(*component)[body] = (*component)[last];
+		component->pop_back();
+	}
+	return true;
+}
+
+void RigidBodies::reserve(size_t count) {
+	entities.reserve(count);
+	for (std::vector<float>* component : { &positionX, &positionY, &positionZ, &velocityX, &velocityY, &velocityZ, &inverseMass, &restitution, &friction }) component->reserve(count);
+	bodies.reserve(count);
+}
+
+void RigidBodies::setPosition(uint32_t body, const glm::vec3& position) {
+	positionX[body] = position.x;
+	positionY[body] = position.y;
+	positionZ[body] = position.z;
+}
+
+void RigidBodies::setVelocity(uint32_t body, const glm::vec3& velocity) {
+	velocityX[body] = velocity.x;
+	velocityY[body] = velocity.y;
+	velocityZ[body] = velocity.z;
+}
+
+void RigidBodies::integrateVelocities(float dt, const glm::vec3& gravity) {
+	//immovable bodies don't fall, the inverse mass masks gravity off for them
+	size_t count = entities.size();
+	size_t i = 0;
+	float* vx = velocityX.data();
+	float* vy = velocityY.data();
+	float* vz = velocityZ.data();
+	const float* w = inverseMass.data();
+#if HAS_SSE2
+	__m128 gx = _mm_set1_ps(gravity.x * dt);
+	__m128 gy = _mm_set1_ps(gravity.y * dt);
+	__m128 gz = _mm_set1_ps(gravity.z * dt);
+	__m128 zero = _mm_setzero_ps();
+	for (; i + 4 <= count; i += 4) {
+		__m128 movable = _mm_cmpgt_ps(_mm_loadu_ps(w + i), zero);
+		_mm_storeu_ps(vx + i, _mm_add_ps(_mm_loadu_ps(vx + i), _mm_and_ps(movable, gx)));
+		_mm_storeu_ps(vy + i, _mm_add_ps(_mm_loadu_ps(vy + i), _mm_and_ps(movable, gy)));
+		_mm_storeu_ps(vz + i, _mm_add_ps(_mm_loadu_ps(vz + i), _mm_and_ps(movable, gz)));
+	}
+#endif
+	glm::vec3 step = gravity * dt;
+	for (; i < count; i++) {
+		if (!(w[i] > 0.0f)) continue;
+		vx[i] += step.x;
+		vy[i] += step.y;
+		vz[i] += step.z;
+	}
+}
+
+void RigidBodies::integratePositions(float dt) {
+	size_t count = entities.size();
+	float* positions[3] = { positionX.data(), positionY.data(), positionZ.data() };
+	const float* velocities[3] = { velocityX.data(), velocityY.data(), velocityZ.data() };
+	for (int axis = 0; axis < 3; axis++) {
+		float* p = positions[axis];
+		const float* v = velocities[axis];
+		size_t i = 0;
+#if HAS_SSE2
+		__m128 step = _mm_set1_ps(dt);
+		for (; i + 4 <= count; i += 4) _mm_storeu_ps(p + i, _mm_add_ps(_mm_loadu_ps(p + i), _mm_mul_ps(_mm_loadu_ps(v + i), step)));
+#endif
+		for (; i < count; i++) p[i] += v[i] * dt;
+	}
+}
@@ -0,0 +1,42 @@
+#pragma once
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_INTRINSICS
+#include <glm/glm.hpp>
+#include "config.h"
+#include <vector>
+#include <unordered_map>
+
+//rigid body components as dense structure of arrays, one float array per component so integration runs straight
+//down them 4 bodies at a time. body i belongs to entity entities[i], removing a body moves the last one into its
+//slot. bodies only translate. partitions take boxes for static geometry and don't pair them with each other, so
+//only spheres get bodies, PhysicsManager::addBody turns anything else away. a body owns its entity's position,
+//PhysicsManager::step writes it back
+class RigidBodies {
+public:
+	static constexpr uint32_t nullBody = UINT32_MAX;
+	//inverse mass 0 makes the body kinematic, neither gravity nor contacts change its velocity
+	uint32_t add(uint32_t entityIndex, const glm::vec3& position, float inverseMass, float restitution, float friction, const glm::vec3& velocity = glm::vec3{ 0.0f });
+	bool remove(uint32_t entityIndex);
+	uint32_t find(uint32_t entityIndex) const {
+		auto it = bodies.find(entityIndex);
+		return it == bodies.end() ? nullBody : it->second;
+	}
+	size_t size() const { return entities.size(); }
+	void reserve(size_t count);
+	//semi-implicit Euler is split in two so contacts can be solved between the halves:
+	//velocities pick up gravity first, then positions move with the velocities the solver left
+	void integrateVelocities(float dt, const glm::vec3& gravity);
+	void integratePositions(float dt);
+	glm::vec3 getPosition(uint32_t body) const { return glm::vec3(positionX[body], positionY[body], positionZ[body]); }
+	void setPosition(uint32_t body, const glm::vec3& position);
+	glm::vec3 getVelocity(uint32_t body) const { return glm::vec3(velocityX[body], velocityY[body], velocityZ[body]); }
+	void setVelocity(uint32_t body, const glm::vec3& velocity);
+	std::vector<uint32_t> entities;
+	std::vector<float> positionX, positionY, positionZ;
+	std::vector<float> velocityX, velocityY, velocityZ;
+	std::vector<float> inverseMass;
+	std::vector<float> restitution;
+	std::vector<float> friction;
+private:
+	std::unordered_map<uint32_t, uint32_t> bodies; //entity index to body
+};
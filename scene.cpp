@@ -1,11 +1,14 @@
 #include "scene.h"
-#include <assimp/Importer.hpp>
-#include <assimp/config.h>
-#include <assimp/scene.h>
+#include "jobs.h"
 #include <iostream>
 #include <nlohmann/json.hpp>
 #include <array>
 #include <fstream>
+#include <algorithm>
+#include <numeric>
+#if HAS_SSE2
+#include <emmintrin.h>
+#endif
 
 uint32_t GameEntity::entitiesCreated = 0;
 
@@ -17,24 +20,16 @@ void EntityManager::setScale(uint32_t index, glm::vec3 scale) {
 	bool isSphere = false;
 	switch (gameEntity.boundType) {
 		case BoundType::Sphere: 
-		{
 			isSphere = true;
-			auto sphereIt = boundingSpheres.find(index);
-			if (sphereIt != boundingSpheres.end()) {
-				sphereIt->second.radius = scale.x;
-			}
-		}
-		break;
+			boundingSpheres[gameEntity.shape].radius = scale.x;
+			break;
 		case BoundType::AABB: 
-		{
-			auto aabbIt = aabbs.find(index);
-			if (aabbIt != aabbs.end()) {
-				aabbIt->second.halfExtent = scale / 2.0f;
-			}
-		}
-		break;
+			aabbs[gameEntity.shape].halfExtent = scale / 2.0f;
+			break;
+		default:
+			break;
 	}
-	spatialPartition.update(index);
+	if (gameEntity.proxy != nullProxy) spatialPartition.markDirty(gameEntity.proxy);
 	if (isSphere) gameEntity.scale = glm::vec3(scale.x);
 	auto renderableIt = renderables.find(index);
 	if (renderableIt != renderables.end()) {
@@ -53,23 +48,15 @@ void EntityManager::setPos(uint32_t index, glm::vec3& pos) {
 	gameEntity.pos = pos;
 	switch (gameEntity.boundType) {
 		case BoundType::Sphere: 
-		{
-			auto sphereIt = boundingSpheres.find(index);
-			if (sphereIt != boundingSpheres.end()) {
-				sphereIt->second.center = pos;
-			}
-		}
-		break;
+			boundingSpheres[gameEntity.shape].center = pos;
+			break;
 		case BoundType::AABB:
-		{
-			auto aabbIt = aabbs.find(index);
-			if (aabbIt != aabbs.end()) {
-				aabbIt->second.center = pos;
-			}
-		}
-		break;
+			aabbs[gameEntity.shape].center = pos;
+			break;
+		default:
+			break;
 	}
-	spatialPartition.update(index);
+	if (gameEntity.proxy != nullProxy) spatialPartition.markDirty(gameEntity.proxy);
 	auto renderableIt = renderables.find(index);
 	if (renderableIt != renderables.end()) {
 		glm::mat4 model{ 1.0f };
@@ -80,7 +67,54 @@ void EntityManager::setPos(uint32_t index, glm::vec3& pos) {
 	}
 }
 
+void EntityManager::setSpherePositions(const std::vector<uint32_t>& indices, const std::vector<glm::vec3>& positions) {
+	assert(indices.size() == positions.size());
+	for (size_t i = 0; i < indices.size(); i++) {
+		auto gameEntityIt = gameEntities.find(indices[i]);
+		if (gameEntityIt == gameEntities.end()) continue;
+		GameEntity& gameEntity = gameEntityIt->second;
+		assert(gameEntity.boundType == BoundType::Sphere);
+		if (gameEntity.boundType != BoundType::Sphere) continue;
+		gameEntity.pos = positions[i];
+		boundingSpheres[gameEntity.shape].center = positions[i];
+		if (gameEntity.proxy != nullProxy) spatialPartition.markDirty(gameEntity.proxy);
+		auto renderableIt = renderables.find(indices[i]);
+		if (renderableIt != renderables.end()) renderableIt->second.model[3] = glm::vec4(positions[i], 1.0f);
+	}
+}
+
 uint32_t EntityManager::createEntity(Mesh mesh, BoundType boundType, glm::vec3 pos, glm::vec3 scale) {
+	BoundingVolumePair pair = addEntity(mesh, boundType, pos, scale);
+	ProxyHandle proxy = nullProxy;
+	if (boundType == BoundType::AABB) proxy = spatialPartition.insertStatic(pair.first, pair.second);
+	else if (pair.second) proxy = spatialPartition.insert(pair.first, pair.second);
+	gameEntities.at(pair.first).proxy = proxy;
+	return pair.first;
+}
+
+uint32_t EntityManager::createEntities(const std::vector<Mesh>& meshes, const std::vector<BoundType>& boundTypes, const std::vector<glm::vec3>& positions, const std::vector<glm::vec3>& scales) {
+	assert(meshes.size() == boundTypes.size() && meshes.size() == positions.size() && meshes.size() == scales.size());
+	uint32_t first = GameEntity::entitiesCreated;
+	gameEntities.reserve(gameEntities.size() + meshes.size());
+	renderables.reserve(renderables.size() + meshes.size());
+	std::vector<BoundingVolumePair> statics;
+	std::vector<BoundingVolumePair> dynamics;
+	for (size_t i = 0; i < meshes.size(); i++) {
+		Mesh mesh = meshes[i];
+		BoundingVolumePair pair = addEntity(mesh, boundTypes[i], positions[i], scales[i]);
+		if (boundTypes[i] == BoundType::AABB) statics.push_back(pair);
+		else if (pair.second) dynamics.push_back(pair);
+	}
+	std::vector<ProxyHandle> proxies;
+	proxies.reserve(statics.size() + dynamics.size());
+	spatialPartition.insertBatch(statics, true, proxies);
+	spatialPartition.insertBatch(dynamics, false, proxies);
+	for (size_t i = 0; i < statics.size(); i++) gameEntities.at(statics[i].first).proxy = proxies[i];
+	for (size_t i = 0; i < dynamics.size(); i++) gameEntities.at(dynamics[i].first).proxy = proxies[statics.size() + i];
+	return first;
+}
+
+BoundingVolumePair EntityManager::addEntity(Mesh& mesh, BoundType boundType, glm::vec3 pos, glm::vec3 scale) {
 	GameEntity entity;
 	entity.pos = pos;
 	entity.scale = scale;
@@ -92,14 +126,15 @@ uint32_t EntityManager::createEntity(Mesh mesh, BoundType boundType, glm::vec3 p
 	renderables.emplace(entity.index, renderable);
 	entity.boundType = boundType;
 
+	BoundingVolume* boundingVolume = nullptr;
 	switch (boundType) {
 		case BoundType::AABB: 
 		{
 			AABB aabb;
 			aabb.center = pos;
 			aabb.halfExtent = scale / 2.0f;
-			aabbs.emplace(entity.index, aabb);
-			spatialPartition.insert(entity.index, &aabbs.at(entity.index));
+			entity.shape = aabbs.add(entity.index, aabb);
+			boundingVolume = &aabbs[entity.shape].volume;
 		}
 		break;
 		case BoundType::Sphere: 
@@ -107,14 +142,16 @@ uint32_t EntityManager::createEntity(Mesh mesh, BoundType boundType, glm::vec3 p
 			BoundingSphere boundingSphere;
 			boundingSphere.center = pos;
 			boundingSphere.radius = scale.x;
-			boundingSpheres.emplace(entity.index, boundingSphere);
-			spatialPartition.insert(entity.index, &boundingSpheres.at(entity.index));
+			entity.shape = boundingSpheres.add(entity.index, boundingSphere);
+			boundingVolume = &boundingSpheres[entity.shape].volume;
 		}
 		break;
+		default:
+			break;
 	}
 	gameEntities.emplace(entity.index, entity);
 	GameEntity::entitiesCreated++;
-	return entity.index;
+	return BoundingVolumePair{ entity.index, boundingVolume };
 }
 
 bool EntityManager::destroyEntity(uint32_t index) {
@@ -123,23 +160,15 @@ bool EntityManager::destroyEntity(uint32_t index) {
 	GameEntity& gameEntity = gameEntityIt->second;
 	switch (gameEntity.boundType) {
 		case BoundType::AABB: 
-		{
-			auto aabbIt = aabbs.find(index);
-			if (aabbIt != aabbs.end()) {
-				aabbs.erase(aabbIt);
-			}
-			spatialPartition.remove(index);
-		}
-		break;
+			spatialPartition.remove(gameEntity.proxy);
+			aabbs.remove(gameEntity.shape);
+			break;
 		case BoundType::Sphere:
-		{
-			auto sphereIt = boundingSpheres.find(index);
-			if (sphereIt != boundingSpheres.end()) {
-				boundingSpheres.erase(sphereIt);
-			}
-			spatialPartition.remove(index);
-		}
-		break;
+			spatialPartition.remove(gameEntity.proxy);
+			boundingSpheres.remove(gameEntity.shape);
+			break;
+		default:
+			break;
 	}
 	auto renderableIt = renderables.find(index);
 	if (renderableIt != renderables.end()) {
@@ -149,56 +178,18 @@ bool EntityManager::destroyEntity(uint32_t index) {
 	return true;
 }
 
-bool loadModel(Mesh& mesh, const char* modelPath, unsigned int flags) {
-	Assimp::Importer importer;
-	importer.SetPropertyInteger(AI_CONFIG_PP_SBP_REMOVE, aiPrimitiveType_POINT | aiPrimitiveType_LINE);
-	const aiScene* scene = importer.ReadFile(modelPath, flags);
-	if (!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode)
-	{
-		std::cerr << "Assimp error: " << importer.GetErrorString() << std::endl;
-		return false;
-	}
-	std::vector<glm::vec3> vertexAttributes;
-	aiMesh* ai_mesh = scene->mMeshes[0];
-	assert(scene->mNumMeshes == 1);
-	for (size_t i = 0; i < ai_mesh->mNumVertices; i++) {
-		aiVector3D pos = ai_mesh->mVertices[i];
-		vertexAttributes.push_back(glm::vec3(pos.x, pos.y, pos.z));
-		aiVector3D norm = ai_mesh->mNormals[i];
-		vertexAttributes.push_back(glm::vec3(norm.x, norm.y, norm.z));
-	}
-	GLuint vao;
-	glGenVertexArrays(1, &vao);
-	glBindVertexArray(vao);
-	GLuint vbo;
-	glGenBuffers(1, &vbo);
-	glBindBuffer(GL_ARRAY_BUFFER, vbo);
-	glBufferData(GL_ARRAY_BUFFER, sizeof(glm::vec3) * vertexAttributes.size(), vertexAttributes.data(), GL_STATIC_DRAW);
-	std::vector<GLuint> indices;
-	for (size_t i = 0; i < ai_mesh->mNumFaces; i++) {
-		aiFace face = ai_mesh->mFaces[i];
-		for (size_t j = 0; j < face.mNumIndices; j++) {
-			indices.push_back(face.mIndices[j]);
-		}
+BoundingVolume* EntityManager::getBoundingVolume(const GameEntity& gameEntity) {
+	switch (gameEntity.boundType) {
+		case BoundType::AABB:
+			return &aabbs[gameEntity.shape].volume;
+		case BoundType::Sphere:
+			return &boundingSpheres[gameEntity.shape].volume;
+		default:
+			return nullptr;
 	}
-	mesh.numIndices = indices.size();
-	GLuint ebo;
-	glGenBuffers(1, &ebo);
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
-	glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(GLuint) * indices.size(), indices.data(), GL_STATIC_DRAW);
-	glEnableVertexAttribArray(0);
-	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 2 * sizeof(glm::vec3), 0);
-	glEnableVertexAttribArray(1);
-	glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 2 * sizeof(glm::vec3), (void*) (sizeof(glm::vec3)));
-	glBindVertexArray(0);
-	mesh.initialized = true;
-	mesh.vao = vao;
-	mesh.vbo = vbo;
-	mesh.ebo = ebo;
-	return true;
 }
 
-void loadScene(EntityManager& entityManager, const char* path, Mesh& cubeMesh, Mesh& sphereMesh) {
+bool readScene(const char* path, SceneData& sceneData) {
 	using json = nlohmann::json;
 	using vec3 = std::array<float, 3>;
 
@@ -210,7 +201,7 @@ void loadScene(EntityManager& entityManager, const char* path, Mesh& cubeMesh, M
 	if (!file.is_open()) {
 		std::cerr << "Failed to load scene json at path: " << path << std::endl;
 		loadFailed = true;
-		return;
+		return false;
 	}
 
 	try {
@@ -221,377 +212,1069 @@ void loadScene(EntityManager& entityManager, const char* path, Mesh& cubeMesh, M
 		loadFailed = true;
 	}
 	file.close();
-	if (loadFailed) return;
+	if (loadFailed) return false;
 
 	auto posIt = j.find("pos");
-	if (posIt == j.end()) return;
+	if (posIt == j.end()) return false;
 	auto scaleIt = j.find("scale");
-	if (scaleIt == j.end()) return;
+	if (scaleIt == j.end()) return false;
 	auto boundTypeIt = j.find("boundType");
-	if (boundTypeIt == j.end()) return;
+	if (boundTypeIt == j.end()) return false;
 
 	std::vector<vec3> positions = *posIt;
 	std::vector<vec3> scales = *scaleIt;
 	std::vector<uint32_t> boundTypes = *boundTypeIt;
 
+	sceneData.boundTypes.resize(positions.size());
+	sceneData.positions.resize(positions.size());
+	sceneData.scales.resize(positions.size());
 	for (size_t i = 0; i < positions.size(); i++) {
-		Mesh mesh;
-		BoundType boundType = static_cast<BoundType>(boundTypes.at(i));
-		switch (boundType) {
-		case BoundType::AABB:
-			mesh = cubeMesh;
-			break;
-		case BoundType::Sphere:
-			mesh = sphereMesh;
-			break;
-		}
+		sceneData.boundTypes[i] = static_cast<BoundType>(boundTypes.at(i));
 		vec3& pos_ = positions.at(i);
-		glm::vec3 pos{ pos_[0], pos_[1], pos_[2] };
+		sceneData.positions[i] = glm::vec3{ pos_[0], pos_[1], pos_[2] };
 		vec3& scale_ = scales.at(i);
-		glm::vec3 scale{ scale_[0], scale_[1], scale_[2] };
-		entityManager.createEntity(mesh, boundType, pos, scale);
+		sceneData.scales[i] = glm::vec3{ scale_[0], scale_[1], scale_[2] };
 	}
+	return true;
 }
 
-void storeScene(EntityManager& entityManager, const char* path) {
+bool writeScene(const char* path, const SceneData& sceneData) {
 	using json = nlohmann::json;
 	using vec3 = std::array<float, 3>;
 	std::vector<vec3> positions;
 	std::vector<vec3> scales;
 	std::vector<uint32_t> boundType;
+	positions.reserve(sceneData.positions.size());
+	scales.reserve(sceneData.scales.size());
+	boundType.reserve(sceneData.boundTypes.size());
 
 	json j;
-	for (auto& pair : entityManager.gameEntities) {
-		GameEntity& entity = pair.second;
-		glm::vec3 pos = entity.getPos();
+	for (size_t i = 0; i < sceneData.positions.size(); i++) {
+		glm::vec3 pos = sceneData.positions[i];
 		positions.push_back({ pos.x, pos.y, pos.z });
-		glm::vec3 scale = entity.getScale();
+		glm::vec3 scale = sceneData.scales[i];
 		scales.push_back({ scale.x, scale.y, scale.z });
-		boundType.push_back(static_cast<uint32_t>(entity.getBoundType()));
+		boundType.push_back(static_cast<uint32_t>(sceneData.boundTypes[i]));
 	}
 	j["pos"] = positions;
 	j["scale"] = scales;
 	j["boundType"] = boundType;
 	std::fstream file;
 	file.open(path, std::ios_base::out);
+	if (!file.is_open()) {
+		std::cerr << "Failed to write scene json at path: " << path << std::endl;
+		return false;
+	}
 	file << j;
 	file.close();
+	return true;
+}
+
+void loadScene(EntityManager& entityManager, const char* path, Mesh& cubeMesh, Mesh& sphereMesh) {
+	SceneData sceneData;
+	if (!readScene(path, sceneData)) return;
+	std::vector<Mesh> meshes(sceneData.positions.size());
+	for (size_t i = 0; i < meshes.size(); i++) {
+		switch (sceneData.boundTypes[i]) {
+		case BoundType::AABB:
+			meshes[i] = cubeMesh;
+			break;
+		case BoundType::Sphere:
+			meshes[i] = sphereMesh;
+			break;
+		default:
+			break;
+		}
+	}
+	//one batch so the partition can sort everything once instead of inserting entity by entity
+	entityManager.createEntities(meshes, sceneData.boundTypes, sceneData.positions, sceneData.scales);
+}
+
+void storeScene(EntityManager& entityManager, const char* path) {
+	SceneData sceneData;
+	for (auto& pair : entityManager.gameEntities) {
+		GameEntity& entity = pair.second;
+		sceneData.positions.push_back(entity.getPos());
+		sceneData.scales.push_back(entity.getScale());
+		sceneData.boundTypes.push_back(entity.getBoundType());
+	}
+	writeScene(path, sceneData);
+}
+
+void SpatialPartition::clearWorkerPairs(JobSystem& jobs, WorkerPairs& workerPairs) {
+	workerPairs.resize(jobs.getWorkerCount());
+	for (std::vector<CollisionPair>& pairs : workerPairs) pairs.clear();
+}
+
+void SpatialPartition::rayCastBatch(const std::vector<Ray>& rays, std::vector<RayHit>& hits, bool anyHit) const {
+	hits.resize(rays.size());
+	if (!rays.empty()) rayCastRange(rays.data(), hits.data(), rays.size(), anyHit);
 }
 
-void NullPartition::insert(uint32_t entityIndex, BoundingVolume* boundingVolume) {
+void SpatialPartition::rayCastBatch(const std::vector<Ray>& rays, std::vector<RayHit>& hits, bool anyHit, JobSystem& jobs) const {
+	hits.resize(rays.size());
+	//chunks of whole packets, so partitions that trace packets keep neighbouring rays together
+	jobs.parallelFor(static_cast<uint32_t>(rays.size()), 16 * rayPacketSize, [this, &rays, &hits, anyHit](uint32_t begin, uint32_t end, uint32_t) {
+		rayCastRange(rays.data() + begin, hits.data() + begin, end - begin, anyHit);
+	});
+}
+
+void SpatialPartition::mergeWorkerPairs(std::vector<CollisionPair>& out, JobSystem& jobs, WorkerPairs& workerPairs) {
+	size_t offset = out.size();
+	out.resize(offset + std::accumulate(workerPairs.begin(), workerPairs.end(), size_t(0), [](size_t total, const std::vector<CollisionPair>& pairs) {
+		return total + pairs.size();
+	}));
+	jobs.parallelFor(static_cast<uint32_t>(workerPairs.size()), 1, [&out, &workerPairs, offset](uint32_t begin, uint32_t end, uint32_t) {
+		size_t start = offset;
+		for (uint32_t i = 0; i < begin; i++) start += workerPairs[i].size();
+		for (uint32_t i = begin; i < end; i++) {
+			std::copy(workerPairs[i].begin(), workerPairs[i].end(), out.begin() + start);
+			start += workerPairs[i].size();
+		}
+	});
+}
+
+ProxyHandle NullPartition::insert(uint32_t entityIndex, BoundingVolume* boundingVolume) {
 	assert(boundingVolume);
-	list.emplace(entityIndex, boundingVolume);
+	if (freeSlots.empty()) {
+		list.push_back(BoundingVolumePair{ entityIndex, boundingVolume });
+		return static_cast<ProxyHandle>(list.size() - 1);
+	}
+	ProxyHandle proxy = freeSlots.back();
+	freeSlots.pop_back();
+	list[proxy] = BoundingVolumePair{ entityIndex, boundingVolume };
+	return proxy;
+}
+
+void NullPartition::getNearestObjects(ProxyHandle proxy, std::vector<BoundingVolumePair>& out) const {
+	for (size_t i = 0; i < list.size(); i++) {
+		if (i != proxy && list[i].first != UINT32_MAX) out.push_back(list[i]);
+	}
 }
 
-std::vector<BoundingVolumePair>& NullPartition::getNearestObjects(BoundingVolumePair& in) {
-	static std::vector<BoundingVolumePair> all;
-	all.clear();
-	for (auto& pair : list) {
-		if (in.first != pair.first) all.push_back(pair);
+void NullPartition::queryFrustum(const Frustum& frustum, std::vector<BoundingVolumePair>& out) const {
+	for (const BoundingVolumePair& pair : list) {
+		if (pair.first == UINT32_MAX) continue;
+		glm::vec3 center = pair.second->getCenter();
+		glm::vec3 halfExtent = pair.second->getHalfExtent();
+		if (frustum.test(center - halfExtent, center + halfExtent) != Frustum::Result::Outside) out.push_back(pair);
 	}
-	return all;
 }
 
-bool NullPartition::remove(uint32_t entityIndex) {
-	auto it = list.find(entityIndex);
-	if (it == list.end()) return false;
-	list.erase(it);
+bool NullPartition::rayCast(const Ray& ray, RayHit& hit, bool anyHit) const {
+	hit = RayHit{};
+	for (const BoundingVolumePair& pair : list) {
+		if (pair.first == UINT32_MAX) continue;
+		if (closerHit(ray, pair.first, pair.second, hit) && anyHit) return true;
+	}
+	return hit.index != UINT32_MAX;
+}
+
+void NullPartition::getCollisionPairs(std::vector<CollisionPair>& out) const {
+	for (size_t i = 0; i < list.size(); i++) {
+		if (list[i].first == UINT32_MAX) continue;
+		for (size_t j = i + 1; j < list.size(); j++) {
+			if (list[j].first != UINT32_MAX) out.push_back(CollisionPair{ list[i], list[j] });
+		}
+	}
+}
+
+bool NullPartition::remove(ProxyHandle proxy) {
+	if (proxy >= list.size() || list[proxy].first == UINT32_MAX) return false;
+	list[proxy] = BoundingVolumePair{ UINT32_MAX, nullptr };
+	freeSlots.push_back(proxy);
 	return true;
 }
 
-bool NullPartition::update(uint32_t entityIndex) {
+bool NullPartition::update(ProxyHandle) {
 	return true;
 }
 
-void SortedAABBList::insert(uint32_t entityIndex, BoundingVolume* boundingVolume) {
+void NullPartition::clear() {
+	list.clear();
+	freeSlots.clear();
+}
+
+static inline bool endpointLess(uint32_t key, bool isMax, uint32_t compKey, bool compIsMax) {
+	//mins sort before maxes on ties so touching boxes still count as overlapping, same as boxIntersection
+	return key < compKey || (key == compKey && !isMax && compIsMax);
+}
+
+ProxyHandle SortedAABBList::insert(uint32_t entityIndex, BoundingVolume* boundingVolume) {
 	assert(boundingVolume);
-	Node minNode{};
-	minNode.isMax = false;
-	minNode.index = entityIndex;
-	minNode.boundingVolume = boundingVolume;
-	nodes.emplace(std::pair<uint32_t, bool>(entityIndex, false), minNode);
-	Node* minNodeRef = &nodes.find(std::pair<uint32_t, bool>(entityIndex, false))->second;
-	insertHelper(minNodeRef);
-	Node maxNode{};
-	maxNode.isMax = true;
-	maxNode.index = entityIndex;
-	maxNode.boundingVolume = boundingVolume;
-	nodes.emplace(std::pair<uint32_t, bool>(entityIndex, true), maxNode);
-	Node* maxNodeRef = &nodes.find(std::pair<uint32_t, bool>(entityIndex, true))->second;
-	insertHelper(maxNodeRef);
-}
-
-void SortedAABBList::insertHelper(Node* node) {
+	//the endpoints wait for the next flush, putting them in one at a time would shift and renumber the
+	//arrays behind them on every insert
+	uint32_t slot = allocateProxy(entityIndex, boundingVolume);
+	proxies[slot].minPos[0] = UINT32_MAX;
+	insertedProxies.push_back(slot);
+	return slot;
+}
+
+void SortedAABBList::mergeInserted() {
+	auto less = [](const Endpoint& first, const Endpoint& second) {
+		return endpointLess(first.key, first.isMax, second.key, second.isMax);
+	};
+	for (uint32_t slot : insertedProxies) {
+		Proxy& proxy = proxies[slot];
+		proxy.keys.set(proxy.boundingVolume); //may have moved since the insert
+		growExtent(proxy);
+	}
+	//sorted once per axis and merged in, only the endpoints from the first new one on change places
 	for (int i = 0; i < 3; i++) {
-		if (!head[i]) {
-			head[i] = node;
+		std::vector<Endpoint>& axis = endpoints[i];
+		size_t oldSize = axis.size();
+		for (uint32_t slot : insertedProxies) {
+			axis.push_back(Endpoint{ proxies[slot].keys.min[i], slot, 0 });
+			axis.push_back(Endpoint{ proxies[slot].keys.max[i], slot, 1 });
 		}
-		else {
-			BoundingVolume* boundingVolume = node->boundingVolume;
-			float value;
-			if (node->isMax) {
-				value = boundingVolume->getCenter()[i] + boundingVolume->getHalfExtent()[i];
-			}
-			else {
-				value = boundingVolume->getCenter()[i] - boundingVolume->getHalfExtent()[i];
-			}
-			for (Node* p = head[i]; p != nullptr; p = p->next[i]) {
-				BoundingVolume* compBoundingVolume = p->boundingVolume;
-				float compValue;
-				if (p->isMax) {
-					compValue = compBoundingVolume->getCenter()[i] + compBoundingVolume->getHalfExtent()[i];
-				}
-				else {
-					compValue = compBoundingVolume->getCenter()[i] - compBoundingVolume->getHalfExtent()[i];
-				}
-				if (value <= compValue) {
-					if (p == head[i]) {
-						node->next[i] = p;
-						p->prev[i] = node;
-						head[i] = node;
-						node->prev[i] = nullptr;
-						break;
-					}
-					else {
-						Node* p_prev = p->prev[i];
-						p_prev->next[i] = node;
-						p->prev[i] = node;
-						node->prev[i] = p_prev;
-						node->next[i] = p;
-						break;
-					}
-				}
-				if (!p->next[i]) {
-					p->next[i] = node;
-					node->prev[i] = p;
-					node->next[i] = nullptr;
-					break;
-				}
-			}
+		std::sort(axis.begin() + oldSize, axis.end(), less);
+		uint32_t first = static_cast<uint32_t>(std::upper_bound(axis.begin(), axis.begin() + oldSize, axis[oldSize], less) - axis.begin());
+		std::inplace_merge(axis.begin(), axis.begin() + oldSize, axis.end(), less);
+		renumber(i, first);
+	}
+	//no swaps bring the new boxes in, so seed the pair set with whatever each already overlaps
+	const std::vector<Endpoint>& axis = endpoints[0];
+	for (uint32_t slot : insertedProxies) {
+		const Proxy& proxy = proxies[slot];
+		for (uint32_t pos = firstCandidate(fromSortKey(proxy.keys.min[0])); pos < proxy.maxPos[0]; pos++) {
+			if (!axis[pos].isMax) addPair(slot, axis[pos].proxy);
 		}
+		refreshStaticPairs(slot);
 	}
+	insertedProxies.clear();
 }
 
-bool SortedAABBList::remove(uint32_t entityIndex) {
-	auto min_it = nodes.find(std::pair<uint32_t, bool>(entityIndex, false));
-	if (min_it == nodes.end()) return false;
-	auto max_it = nodes.find(std::pair<uint32_t, bool>(entityIndex, true));
-	if (max_it == nodes.end()) return false;
-	Node& min_node = min_it->second;
-	for (int i = 0; i < 3; i++) {
-		if (head[i] == &min_node) {
-			if(min_node.next[i]) min_node.next[i]->prev[i] = nullptr;
-			head[i] = min_node.next[i];
+uint32_t SortedAABBList::allocateProxy(uint32_t entityIndex, BoundingVolume* boundingVolume) {
+	uint32_t slot;
+	if (!freeProxies.empty()) {
+		slot = freeProxies.back();
+		freeProxies.pop_back();
+	}
+	else {
+		slot = static_cast<uint32_t>(proxies.size());
+		assert(slot < staticHandle); //endpoints only have 31 bits for it
+		proxies.emplace_back();
+		staticOverlaps.push_back(UINT32_MAX);
+	}
+	Proxy& proxy = proxies[slot];
+	proxy.index = entityIndex;
+	proxy.boundingVolume = boundingVolume;
+	proxy.keys.set(boundingVolume);
+	growExtent(proxy);
+	return slot;
+}
+
+void SortedAABBList::insertBatch(const std::vector<BoundingVolumePair>& boundingVolumes, bool isStatic, std::vector<ProxyHandle>& handles) {
+	if (boundingVolumes.empty()) return;
+	if (isStatic) {
+		for (const BoundingVolumePair& pair : boundingVolumes) {
+			StaticProxy proxy;
+			proxy.min = pair.second->getCenter() - pair.second->getHalfExtent();
+			proxy.max = pair.second->getCenter() + pair.second->getHalfExtent();
+			proxy.index = pair.first;
+			proxy.handle = allocateStaticHandle();
+			proxy.boundingVolume = pair.second;
+			staticProxies.push_back(proxy);
+			handles.push_back(proxy.handle | staticHandle);
 		}
-		else {
-			min_node.prev[i]->next[i] = min_node.next[i];
-			if (min_node.next[i]) min_node.next[i]->prev[i] = min_node.prev[i];
+		buildStaticTree(); //fills in staticSlots
+		for (uint32_t slot = 0; slot < proxies.size(); slot++) {
+			if (proxies[slot].index != UINT32_MAX) refreshStaticPairs(slot);
 		}
+		return;
+	}
+	//sort the new endpoints once per axis and merge them into the arrays, O(n log n) instead of
+	//shifting the whole array for every endpoint. single inserts still waiting go in first
+	if (!insertedProxies.empty()) mergeInserted();
+	std::vector<uint32_t> newProxies;
+	newProxies.reserve(boundingVolumes.size());
+	if (boundingVolumes.size() > freeProxies.size()) {
+		//exactly what the batch needs, growing by doubling would leave up to half the slots unused
+		proxies.reserve(proxies.size() + boundingVolumes.size() - freeProxies.size());
+		staticOverlaps.reserve(proxies.capacity());
 	}
-	nodes.erase(min_it);
-	Node& max_node = max_it->second;
+	for (const BoundingVolumePair& pair : boundingVolumes) {
+		assert(pair.second);
+		newProxies.push_back(allocateProxy(pair.first, pair.second));
+	}
+	handles.insert(handles.end(), newProxies.begin(), newProxies.end());
+	auto less = [](const Endpoint& first, const Endpoint& second) {
+		return endpointLess(first.key, first.isMax, second.key, second.isMax);
+	};
 	for (int i = 0; i < 3; i++) {
-		if (head[i] == &max_node) {
-			if (max_node.next[i]) max_node.next[i]->prev[i] = nullptr;
-			head[i] = max_node.next[i];
+		std::vector<Endpoint>& axis = endpoints[i];
+		size_t oldSize = axis.size();
+		axis.reserve(oldSize + 2 * newProxies.size());
+		for (uint32_t slot : newProxies) {
+			axis.push_back(Endpoint{ proxies[slot].keys.min[i], slot, 0 });
+			axis.push_back(Endpoint{ proxies[slot].keys.max[i], slot, 1 });
 		}
-		else {
-			max_node.prev[i]->next[i] = max_node.next[i];
-			if (max_node.next[i]) max_node.next[i]->prev[i] = max_node.prev[i];
+		std::sort(axis.begin() + oldSize, axis.end(), less);
+		std::inplace_merge(axis.begin(), axis.begin() + oldSize, axis.end(), less);
+		renumber(i, 0);
+	}
+	//one sweep along x for the new pairs, pairs between two old entities are already in the map and emplace leaves them be
+	std::vector<uint32_t> active;
+	for (const Endpoint& endpoint : endpoints[0]) {
+		const Proxy& proxy = proxies[endpoint.proxy];
+		if (endpoint.isMax || proxy.index == UINT32_MAX) continue;
+		for (size_t k = 0; k < active.size();) {
+			const Proxy& activeProxy = proxies[active[k]];
+			if (activeProxy.keys.max[0] < proxy.keys.min[0]) { //ended before this one starts, drop it while we're here
+				active[k] = active.back();
+				active.pop_back();
+				continue;
+			}
+			k++;
+			if (!proxy.keys.overlaps(activeProxy.keys)) continue;
+			collisionPairs.emplace(std::pair<uint32_t, uint32_t>(proxy.index, activeProxy.index), std::pair<BoundingVolume*, BoundingVolume*>(proxy.boundingVolume, activeProxy.boundingVolume));
 		}
+		active.push_back(endpoint.proxy);
 	}
-	nodes.erase(max_it);
+	if (!staticProxies.empty()) {
+		for (uint32_t slot : newProxies) refreshStaticPairs(slot);
+	}
+}
+
+ProxyHandle SortedAABBList::insertStatic(uint32_t entityIndex, BoundingVolume* boundingVolume) {
+	assert(boundingVolume);
+	uint32_t handle = allocateStaticHandle();
+	addStatic(handle, entityIndex, boundingVolume);
+	return handle | staticHandle;
+}
+
+uint32_t SortedAABBList::allocateStaticHandle() {
+	if (freeStaticHandles.empty()) {
+		staticSlots.push_back(UINT32_MAX);
+		staticDynamics.push_back(UINT32_MAX);
+		return static_cast<uint32_t>(staticSlots.size() - 1);
+	}
+	uint32_t handle = freeStaticHandles.back();
+	freeStaticHandles.pop_back();
+	return handle;
+}
+
+void SortedAABBList::addStatic(uint32_t handle, uint32_t entityIndex, BoundingVolume* boundingVolume) {
+	StaticProxy proxy;
+	proxy.min = boundingVolume->getCenter() - boundingVolume->getHalfExtent();
+	proxy.max = boundingVolume->getCenter() + boundingVolume->getHalfExtent();
+	proxy.index = entityIndex;
+	proxy.handle = handle;
+	proxy.boundingVolume = boundingVolume;
+	staticSlots[handle] = static_cast<uint32_t>(staticProxies.size());
+	staticProxies.push_back(proxy);
+	EndpointKeys keys;
+	keys.set(boundingVolume);
+	//only dynamic-static pairs, statics never pair with each other
+	const std::vector<Endpoint>& axis = endpoints[0];
+	for (auto it = axis.begin() + firstCandidate(fromSortKey(keys.min[0])); it != axis.end() && it->key <= keys.max[0]; ++it) {
+		if (it->isMax) continue;
+		const Proxy& other = proxies[it->proxy];
+		if (other.index == UINT32_MAX || !other.keys.overlaps(keys)) continue;
+		collisionPairs.emplace(std::pair<uint32_t, uint32_t>(other.index, entityIndex), std::pair<BoundingVolume*, BoundingVolume*>(other.boundingVolume, boundingVolume));
+		linkStatic(it->proxy, handle);
+	}
+}
+
+void SortedAABBList::removeStatic(uint32_t handle) {
+	StaticProxy& proxy = staticProxies[staticSlots[handle]];
+	while (staticDynamics[handle] != UINT32_MAX) {
+		uint32_t link = staticDynamics[handle];
+		collisionPairs.erase(std::pair<uint32_t, uint32_t>(proxies[staticLinks[link].slot].index, proxy.index));
+		unlinkStatic(link);
+	}
+	proxy.index = UINT32_MAX;
+	proxy.handle = UINT32_MAX;
+	proxy.boundingVolume = nullptr;
+	removedStatics++;
+}
+
+template<typename Func>
+void SortedAABBList::queryStatic(const glm::vec3& min, const glm::vec3& max, Func func) {
+	size_t pending = staticProxies.size() - builtStatics;
+	if (pending > 16 + builtStatics / 4 || removedStatics > 16 + builtStatics / 4) buildStaticTree();
+	auto overlap = [&min, &max](const glm::vec3& otherMin, const glm::vec3& otherMax) {
+		if (otherMin.x > max.x || min.x > otherMax.x) return false;
+		if (otherMin.y > max.y || min.y > otherMax.y) return false;
+		if (otherMin.z > max.z || min.z > otherMax.z) return false;
+		return true;
+	};
+	if (!staticNodes.empty()) {
+		uint32_t stack[64];
+		int top = 0;
+		stack[top++] = 0;
+		while (top > 0) {
+			const StaticNode& node = staticNodes[stack[--top]];
+			if (!overlap(node.min, node.max)) continue;
+			if (node.left != UINT32_MAX) {
+				stack[top++] = node.left;
+				stack[top++] = node.right;
+				continue;
+			}
+			for (uint32_t i = node.first; i < node.first + node.count; i++) {
+				const StaticProxy& proxy = staticProxies[i];
+				if (proxy.index != UINT32_MAX && overlap(proxy.min, proxy.max)) func(proxy);
+			}
+		}
+	}
+	for (size_t i = builtStatics; i < staticProxies.size(); i++) {
+		const StaticProxy& proxy = staticProxies[i];
+		if (proxy.index != UINT32_MAX && overlap(proxy.min, proxy.max)) func(proxy);
+	}
+}
+
+void SortedAABBList::linkStatic(uint32_t slot, uint32_t handle) {
+	uint32_t link;
+	if (!freeStaticLinks.empty()) {
+		link = freeStaticLinks.back();
+		freeStaticLinks.pop_back();
+	}
+	else {
+		link = static_cast<uint32_t>(staticLinks.size());
+		staticLinks.emplace_back();
+	}
+	StaticLink& entry = staticLinks[link];
+	entry.slot = slot;
+	entry.handle = handle;
+	uint32_t* heads[2] = { &staticOverlaps[slot], &staticDynamics[handle] };
+	for (int side = 0; side < 2; side++) {
+		entry.prev[side] = UINT32_MAX;
+		entry.next[side] = *heads[side];
+		if (*heads[side] != UINT32_MAX) staticLinks[*heads[side]].prev[side] = link;
+		*heads[side] = link;
+	}
+}
+
+void SortedAABBList::unlinkStatic(uint32_t link) {
+	const StaticLink& entry = staticLinks[link];
+	uint32_t* heads[2] = { &staticOverlaps[entry.slot], &staticDynamics[entry.handle] };
+	for (int side = 0; side < 2; side++) {
+		if (entry.prev[side] != UINT32_MAX) staticLinks[entry.prev[side]].next[side] = entry.next[side];
+		else *heads[side] = entry.next[side];
+		if (entry.next[side] != UINT32_MAX) staticLinks[entry.next[side]].prev[side] = entry.prev[side];
+	}
+	freeStaticLinks.push_back(link);
+}
+
+void SortedAABBList::clearStaticPairs(uint32_t slot) {
+	while (staticOverlaps[slot] != UINT32_MAX) {
+		uint32_t link = staticOverlaps[slot];
+		collisionPairs.erase(std::pair<uint32_t, uint32_t>(proxies[slot].index, getStatic(staticLinks[link].handle).index));
+		unlinkStatic(link);
+	}
+}
+
+void SortedAABBList::refreshStaticPairs(uint32_t slot) {
+	const Proxy& proxy = proxies[slot];
+	clearStaticPairs(slot);
+	glm::vec3 min = proxy.boundingVolume->getCenter() - proxy.boundingVolume->getHalfExtent();
+	glm::vec3 max = proxy.boundingVolume->getCenter() + proxy.boundingVolume->getHalfExtent();
+	queryStatic(min, max, [&](const StaticProxy& staticProxy) {
+		linkStatic(slot, staticProxy.handle);
+		collisionPairs.emplace(std::pair<uint32_t, uint32_t>(proxy.index, staticProxy.index), std::pair<BoundingVolume*, BoundingVolume*>(proxy.boundingVolume, staticProxy.boundingVolume));
+	});
+}
+
+void SortedAABBList::buildStaticTree() {
+	staticProxies.erase(std::remove_if(staticProxies.begin(), staticProxies.end(), [](const StaticProxy& proxy) {
+		return proxy.index == UINT32_MAX;
+	}), staticProxies.end());
+	staticNodes.clear();
+	if (!staticProxies.empty()) buildStaticNode(0, static_cast<uint32_t>(staticProxies.size()));
+	for (uint32_t i = 0; i < staticProxies.size(); i++) {
+		staticSlots[staticProxies[i].handle] = i;
+	}
+	builtStatics = staticProxies.size();
+	removedStatics = 0;
+}
+
+uint32_t SortedAABBList::buildStaticNode(uint32_t first, uint32_t count) {
+	uint32_t nodeIndex = static_cast<uint32_t>(staticNodes.size());
+	staticNodes.emplace_back();
+	glm::vec3 min = staticProxies[first].min;
+	glm::vec3 max = staticProxies[first].max;
+	glm::vec3 centerMin = (min + max) * 0.5f;
+	glm::vec3 centerMax = centerMin;
+	for (uint32_t i = first + 1; i < first + count; i++) {
+		const StaticProxy& proxy = staticProxies[i];
+		min = glm::min(min, proxy.min);
+		max = glm::max(max, proxy.max);
+		glm::vec3 center = (proxy.min + proxy.max) * 0.5f;
+		centerMin = glm::min(centerMin, center);
+		centerMax = glm::max(centerMax, center);
+	}
+	staticNodes[nodeIndex].min = min;
+	staticNodes[nodeIndex].max = max;
+	if (count <= 4) {
+		staticNodes[nodeIndex].first = first;
+		staticNodes[nodeIndex].count = count;
+		return nodeIndex;
+	}
+	//median split along the axis the centers are most spread on, keeps the depth at log2(n / 4)
+	glm::vec3 spread = centerMax - centerMin;
+	int axis = (spread.x > spread.y && spread.x > spread.z) ? 0 : (spread.y > spread.z ? 1 : 2);
+	uint32_t half = count / 2;
+	std::nth_element(staticProxies.begin() + first, staticProxies.begin() + first + half, staticProxies.begin() + first + count,
+		[axis](const StaticProxy& a, const StaticProxy& b) {
+			return a.min[axis] + a.max[axis] < b.min[axis] + b.max[axis];
+		});
+	uint32_t left = buildStaticNode(first, half);
+	uint32_t right = buildStaticNode(first + half, count - half);
+	staticNodes[nodeIndex].left = left;
+	staticNodes[nodeIndex].right = right;
+	return nodeIndex;
+}
+
+bool SortedAABBList::remove(ProxyHandle proxy) {
+	if (proxy & staticHandle) {
+		uint32_t handle = proxy & ~staticHandle;
+		if (!isLiveStatic(handle)) return false;
+		removeStatic(handle);
+		staticSlots[handle] = UINT32_MAX;
+		freeStaticHandles.push_back(handle);
+		return true;
+	}
+	if (!isLive(proxy)) return false;
+	Proxy& removed = proxies[proxy];
+	if (isInserted(proxy)) {
+		//never made it into the arrays or the pair set
+		insertedProxies.erase(std::find(insertedProxies.begin(), insertedProxies.end(), proxy));
+		removed.index = UINT32_MAX;
+		removed.boundingVolume = nullptr;
+		freeProxies.push_back(proxy);
+		return true;
+	}
+	//the map only holds pairs whose cached keys overlap, so they are found the way insert seeds them, from
+	//the mins close enough before our max on x, instead of going through every pair
+	const std::vector<Endpoint>& axis = endpoints[0];
+	for (uint32_t pos = firstCandidate(fromSortKey(removed.keys.min[0])); pos < removed.maxPos[0]; pos++) {
+		const Endpoint& endpoint = axis[pos];
+		if (endpoint.isMax || endpoint.proxy == proxy) continue;
+		const Proxy& other = proxies[endpoint.proxy];
+		if (other.index == UINT32_MAX || !other.keys.overlaps(removed.keys)) continue;
+		collisionPairs.erase(std::pair<uint32_t, uint32_t>(removed.index, other.index));
+	}
+	clearStaticPairs(proxy);
+	//the endpoints stay behind as dead weight that never pairs, closing the gaps right away would shift
+	//every array on every remove
+	removed.index = UINT32_MAX;
+	removed.boundingVolume = nullptr;
+	removedProxies.push_back(proxy);
+	if (removedProxies.size() > 64 + proxies.size() / 8) compact();
 	return true;
 }
 
-bool SortedAABBList::update(uint32_t entityIndex) {
-	auto min_it = nodes.find(std::pair<uint32_t, bool>(entityIndex, false));
-	if (min_it == nodes.end()) return false;
-	auto max_it = nodes.find(std::pair<uint32_t, bool>(entityIndex, true));
-	if (max_it == nodes.end()) return false;
-	updateHelper(min_it);
-	updateHelper(max_it);
+uint32_t SortedAABBList::firstCandidate(float min) const {
+	const std::vector<Endpoint>& axis = endpoints[0];
+	auto it = std::lower_bound(axis.begin(), axis.end(), toSortKey(min - 2.0f * maxExtent), [](const Endpoint& endpoint, uint32_t key) {
+		return endpoint.key < key;
+	});
+	return static_cast<uint32_t>(it - axis.begin());
+}
+
+void SortedAABBList::compact() {
+	for (int i = 0; i < 3; i++) {
+		std::vector<Endpoint>& axis = endpoints[i];
+		axis.erase(std::remove_if(axis.begin(), axis.end(), [this](const Endpoint& endpoint) {
+			return proxies[endpoint.proxy].index == UINT32_MAX;
+		}), axis.end());
+		renumber(i, 0);
+	}
+	freeProxies.insert(freeProxies.end(), removedProxies.begin(), removedProxies.end());
+	removedProxies.clear();
+	maxExtent = 0.0f;
+	for (const Proxy& proxy : proxies) {
+		if (proxy.index != UINT32_MAX) growExtent(proxy);
+	}
+}
+
+bool SortedAABBList::update(ProxyHandle proxy) {
+	if (proxy & staticHandle) {
+		uint32_t handle = proxy & ~staticHandle;
+		if (!isLiveStatic(handle)) return false;
+		//statics aren't supposed to move (editor only), just take it out and put it back under the same handle
+		uint32_t entityIndex = getStatic(handle).index;
+		BoundingVolume* boundingVolume = getStatic(handle).boundingVolume;
+		removeStatic(handle);
+		addStatic(handle, entityIndex, boundingVolume);
+		return true;
+	}
+	if (!isLive(proxy)) return false;
+	if (isInserted(proxy)) return true; //its bounds are read when it is merged in
+	Proxy& moved = proxies[proxy];
+	refreshKeys(moved);
+	for (int i = 0; i < 3; i++) {
+		moveEndpoint(i, moved.minPos[i]);
+		moveEndpoint(i, moved.maxPos[i]); //read after the min moved, it may have stepped past the max
+	}
+	refreshStaticPairs(proxy);
 	return true;
 }
 
-void SortedAABBList::updateHelper(decltype(nodes)::iterator it) {
-	Node& node = it->second;
+void SortedAABBList::refreshKeys(Proxy& proxy) {
+	proxy.keys.set(proxy.boundingVolume);
+	growExtent(proxy);
 	for (int i = 0; i < 3; i++) {
-		float value;
-		if (node.isMax) {
-			value = node.boundingVolume->getCenter()[i] + node.boundingVolume->getHalfExtent()[i];
-		}
-		else {
-			value = node.boundingVolume->getCenter()[i] - node.boundingVolume->getHalfExtent()[i];
-		}
-		Node* prev_node = node.prev[i];
-		if (prev_node) {
-			float prev_value;
-			if (prev_node->isMax) {
-				prev_value = prev_node->boundingVolume->getCenter()[i] + prev_node->boundingVolume->getHalfExtent()[i];
-			}
-			else {
-				prev_value = prev_node->boundingVolume->getCenter()[i] - prev_node->boundingVolume->getHalfExtent()[i];
-			}
-			while (prev_value > value && prev_node != nullptr) {
-				swap(i, prev_node, &node);
-				prev_node = prev_node->prev[i];
-				if (prev_node->isMax) {
-					prev_value = prev_node->boundingVolume->getCenter()[i] + prev_node->boundingVolume->getHalfExtent()[i];
-				}
-				else {
-					prev_value = prev_node->boundingVolume->getCenter()[i] - prev_node->boundingVolume->getHalfExtent()[i];
-				}
-			}
+		endpoints[i][proxy.minPos[i]].key = proxy.keys.min[i];
+		endpoints[i][proxy.maxPos[i]].key = proxy.keys.max[i];
+	}
+}
+
+void SortedAABBList::flushUpdates() {
+	if (!insertedProxies.empty()) mergeInserted();
+	if (dirtyProxies.empty()) return;
+	if (dirtyProxies.size() < proxies.size() / 16) {
+		//only a handful moved, walking them into place one by one beats sweeping every array. update() re-reads
+		//the bounds of the proxy it moves only, every other endpoint keeps the key it was sorted under (the
+		//other dirty ones included) so each walk runs over a sorted array and sees every crossing once
+		SpatialPartition::flushUpdates();
+		return;
+	}
+	//statics go through remove/add and need the arrays sorted to find their dynamic pairs
+	std::vector<ProxyHandle> movedStatics;
+	for (ProxyHandle proxy : dirtyProxies) {
+		if (proxy & staticHandle) movedStatics.push_back(proxy);
+		else if (isLive(proxy)) refreshKeys(proxies[proxy]);
+	}
+	for (int i = 0; i < 3; i++) sortAxis(i);
+	for (ProxyHandle proxy : movedStatics) update(proxy);
+	if (!staticProxies.empty()) {
+		for (ProxyHandle proxy : dirtyProxies) {
+			if (!(proxy & staticHandle) && isLive(proxy)) refreshStaticPairs(proxy);
 		}
-		Node* next_node = node.next[i];
-		if (next_node) {
-			float next_value;
-			if (next_node->isMax) {
-				next_value = next_node->boundingVolume->getCenter()[i] + next_node->boundingVolume->getHalfExtent()[i];
-			}
-			else {
-				next_value = next_node->boundingVolume->getCenter()[i] - next_node->boundingVolume->getHalfExtent()[i];
-			}
-			while (next_value < value && next_node != nullptr) {
-				swap(i, &node, next_node);
-				next_node = next_node->next[i];
-				if (next_node->isMax) {
-					next_value = next_node->boundingVolume->getCenter()[i] + next_node->boundingVolume->getHalfExtent()[i];
-				}
-				else {
-					next_value = next_node->boundingVolume->getCenter()[i] - next_node->boundingVolume->getHalfExtent()[i];
-				}
-			}
+	}
+	dirtyProxies.clear();
+}
+
+void SortedAABBList::sortAxis(int i) {
+	//insertion sort over the whole array, the same crossings moveEndpoint sees happen here as well
+	//and each inverted min/max pair is swapped exactly once
+	std::vector<Endpoint>& axis = endpoints[i];
+	for (uint32_t j = 1; j < axis.size(); j++) {
+		Endpoint endpoint = axis[j];
+		uint32_t pos = j;
+		while (pos > 0 && endpointLess(endpoint.key, endpoint.isMax, axis[pos - 1].key, axis[pos - 1].isMax)) {
+			Endpoint prev = axis[pos - 1];
+			if (!endpoint.isMax && prev.isMax) addPair(endpoint.proxy, prev.proxy);
+			else if (endpoint.isMax && !prev.isMax) removePair(endpoint.proxy, prev.proxy);
+			setEndpoint(i, pos, prev);
+			pos--;
 		}
+		if (pos != j) setEndpoint(i, pos, endpoint);
 	}
 }
 
+void SortedAABBList::moveEndpoint(int i, uint32_t pos) {
+	std::vector<Endpoint>& axis = endpoints[i];
+	Endpoint endpoint = axis[pos];
+	uint32_t start = pos;
+	//every min/max crossing is a pair starting or stopping to overlap on this axis
+	while (pos > 0 && endpointLess(endpoint.key, endpoint.isMax, axis[pos - 1].key, axis[pos - 1].isMax)) {
+		Endpoint prev = axis[pos - 1];
+		if (!endpoint.isMax && prev.isMax) addPair(endpoint.proxy, prev.proxy);
+		else if (endpoint.isMax && !prev.isMax) removePair(endpoint.proxy, prev.proxy);
+		setEndpoint(i, pos, prev);
+		pos--;
+	}
+	//the min is moved before the max, so the max ahead of it still occupies its old slot while its
+	//key is already the new one; step past it instead of stopping there, the max steps back after
+	while (pos + 1 < axis.size() && (axis[pos + 1].proxy == endpoint.proxy || endpointLess(axis[pos + 1].key, axis[pos + 1].isMax, endpoint.key, endpoint.isMax))) {
+		Endpoint next = axis[pos + 1];
+		if (endpoint.isMax && !next.isMax) addPair(endpoint.proxy, next.proxy);
+		else if (!endpoint.isMax && next.isMax) removePair(endpoint.proxy, next.proxy);
+		setEndpoint(i, pos, next);
+		pos++;
+	}
+	if (pos != start) setEndpoint(i, pos, endpoint);
+}
+
+void SortedAABBList::setEndpoint(int i, uint32_t pos, Endpoint endpoint) {
+	endpoints[i][pos] = endpoint;
+	Proxy& proxy = proxies[endpoint.proxy];
+	if (endpoint.isMax) proxy.maxPos[i] = pos;
+	else proxy.minPos[i] = pos;
+}
+
+void SortedAABBList::renumber(int i, uint32_t first) {
+	const std::vector<Endpoint>& axis = endpoints[i];
+	for (uint32_t pos = first; pos < axis.size(); pos++) {
+		Proxy& proxy = proxies[axis[pos].proxy];
+		if (axis[pos].isMax) proxy.maxPos[i] = pos;
+		else proxy.minPos[i] = pos;
+	}
+}
 
-void SortedAABBList::swap(int i, Node* first, Node* second) {
-	assert(first && second && (i < 3) && (i >= 0));
+void SortedAABBList::addPair(uint32_t first, uint32_t second) {
 	if (first == second) return;
-	if (head[i] == first) head[i] = second;
-	else if (head[i] == second) head[i] = first;
-	Node* first_prev = first->prev[i];
-	Node* first_next = first->next[i];
-	Node* second_prev = second->prev[i];
-	Node* second_next = second->next[i];
-	if (first_next == second) {
-		if (first_prev) first_prev->next[i] = second;
-		second->prev[i] = first_prev;
-		second->next[i] = first;
-		if (second_next) second_next->prev[i] = first;
-		first->prev[i] = second;
-		first->next[i] = second_next;
-	} else if (first_prev == second) {
-		if (second_prev) second_prev->next[i] = first;
-		if (first_next) first_next->prev[i] = second;
-		first->prev[i] = second_prev;
-		first->next[i] = second;
-		second->prev[i] = first;
-		second->next[i] = first_next;
-	} else {
-		if (first_prev) first_prev->next[i] = second;
-		second->prev[i] = first_prev;
-		second->next[i] = first_next;
-		if (first_next) first_next->prev[i] = second;
-		if (second_prev) second_prev->next[i] = first;
-		first->prev[i] = second_prev;
-		first->next[i] = second_next;
-		if (second_next) second_next->prev[i] = first;
-	}
-}
-
-std::vector<BoundingVolumePair>& SortedAABBList::getNearestObjects(BoundingVolumePair& in) {
+	const Proxy& firstProxy = proxies[first];
+	const Proxy& secondProxy = proxies[second];
+	if (firstProxy.index == UINT32_MAX || secondProxy.index == UINT32_MAX) return; //removed, not compacted yet
+	//crossing on one axis only means overlap there, the pair is real once all three axes agree
+	if (!firstProxy.keys.overlaps(secondProxy.keys)) return;
+	collisionPairs.emplace(std::pair<uint32_t, uint32_t>(firstProxy.index, secondProxy.index), std::pair<BoundingVolume*, BoundingVolume*>(firstProxy.boundingVolume, secondProxy.boundingVolume));
+}
+
+void SortedAABBList::removePair(uint32_t first, uint32_t second) {
+	if (first == second || proxies[first].index == UINT32_MAX || proxies[second].index == UINT32_MAX) return;
+	collisionPairs.erase(std::pair<uint32_t, uint32_t>(proxies[first].index, proxies[second].index));
+}
+
+void SortedAABBList::getNearestObjects(ProxyHandle proxy, std::vector<BoundingVolumePair>& out) const {
 	//debugPrint();
-	static std::vector<BoundingVolumePair> nearestObjects; //called every frame anyway so made static to avoid reallocating
-	nearestObjects.clear();
-	uint32_t index = in.first;
-	BoundingVolume* boundingVolume = in.second;
-	assert(boundingVolume);
-	auto min_it = nodes.find(std::pair<uint32_t, bool>(index, false));
-	if (min_it == nodes.end()) return nearestObjects;
-	auto max_it = nodes.find(std::pair<uint32_t, bool>(index, true));
-	if (max_it == nodes.end()) return nearestObjects;
-	Node& min = min_it->second;
-	Node& max = max_it->second;
-	assert(min.boundingVolume == max.boundingVolume);
-	glm::vec3 min_value = min.boundingVolume->getCenter() - min.boundingVolume->getHalfExtent();
-	glm::vec3 max_value = max.boundingVolume->getCenter() + max.boundingVolume->getHalfExtent();
-	std::unordered_map<uint32_t, uint32_t> potentialNearest;
-	for (int i = 0; i < 3; i++) {
-		assert(min_value[i] <= max_value[i]);
-		for (Node* p = min.next[i]; p != &max; p = p->next[i]) {
-			assert(p);
-			if (p->boundingVolume != boundingVolume) {
-				auto it = potentialNearest.find(p->index);
-				if (it == potentialNearest.end()) {
-					potentialNearest.emplace(p->index, 1);
-				}
-				else {
-					it->second++;
-				}
-			}
+	if (proxy & staticHandle) {
+		uint32_t handle = proxy & ~staticHandle;
+		if (!isLiveStatic(handle)) return;
+		//statics only ever touch dynamics, and those are listed with the static
+		for (uint32_t link = staticDynamics[handle]; link != UINT32_MAX; link = staticLinks[link].next[1]) {
+			const Proxy& other = proxies[staticLinks[link].slot];
+			out.push_back(BoundingVolumePair{ other.index, other.boundingVolume });
 		}
+		return;
+	}
+	if (!isLive(proxy) || isInserted(proxy)) return; //nothing until the flush
+	const Proxy& query = proxies[proxy];
+	const std::vector<Endpoint>& axis = endpoints[0];
+	//everything with an endpoint between our own on x, reported from its min unless that ties or lies before
+	//ours, then from its max, and kept if y and z overlap too. boxes spanning our whole x range are missed
+	//here but we lie inside theirs, so their own query finds us
+	for (uint32_t pos = query.minPos[0] + 1; pos < query.maxPos[0]; pos++) {
+		const Endpoint& endpoint = axis[pos];
+		const Proxy& other = proxies[endpoint.proxy];
+		if (other.index == UINT32_MAX) continue;
+		if (static_cast<bool>(endpoint.isMax) != (other.keys.min[0] <= query.keys.min[0])) continue;
+		if (!other.keys.overlaps(query.keys)) continue;
+		out.push_back(BoundingVolumePair{ other.index, other.boundingVolume });
 	}
-	for (auto pair : potentialNearest) {
-		if (pair.second >= 3) {
-			Node& node = nodes.at(std::pair<uint32_t,bool>(pair.first, true));
-			nearestObjects.push_back(BoundingVolumePair{ pair.first, node.boundingVolume });
+	for (uint32_t link = staticOverlaps[proxy]; link != UINT32_MAX; link = staticLinks[link].next[0]) {
+		const StaticProxy& staticProxy = getStatic(staticLinks[link].handle);
+		out.push_back(BoundingVolumePair{ staticProxy.index, staticProxy.boundingVolume });
+	}
+}
+
+void SortedAABBList::queryFrustum(const Frustum& frustum, std::vector<BoundingVolumePair>& out) const {
+	for (const Proxy& proxy : proxies) {
+		if (proxy.index == UINT32_MAX) continue;
+		glm::vec3 center = proxy.boundingVolume->getCenter();
+		glm::vec3 halfExtent = proxy.boundingVolume->getHalfExtent();
+		if (frustum.test(center - halfExtent, center + halfExtent) != Frustum::Result::Outside) out.push_back(BoundingVolumePair{ proxy.index, proxy.boundingVolume });
+	}
+	//statics through their tree as it was last built, nodes wholly inside hand over their leaves untested
+	auto addStatic = [&frustum, &out](const StaticProxy& staticProxy, bool inside) {
+		if (staticProxy.index == UINT32_MAX) return;
+		if (inside || frustum.test(staticProxy.min, staticProxy.max) != Frustum::Result::Outside) out.push_back(BoundingVolumePair{ staticProxy.index, staticProxy.boundingVolume });
+	};
+	if (!staticNodes.empty()) {
+		uint32_t stack[64];
+		bool insideStack[64];
+		int top = 0;
+		stack[top] = 0;
+		insideStack[top++] = false;
+		while (top > 0) {
+			top--;
+			const StaticNode& node = staticNodes[stack[top]];
+			bool inside = insideStack[top];
+			if (!inside) {
+				Frustum::Result result = frustum.test(node.min, node.max);
+				if (result == Frustum::Result::Outside) continue;
+				inside = result == Frustum::Result::Inside;
+			}
+			if (node.left != UINT32_MAX) {
+				stack[top] = node.left;
+				insideStack[top++] = inside;
+				stack[top] = node.right;
+				insideStack[top++] = inside;
+				continue;
+			}
+			for (uint32_t i = node.first; i < node.first + node.count; i++) addStatic(staticProxies[i], inside);
 		}
 	}
-	return nearestObjects;
+	for (size_t i = builtStatics; i < staticProxies.size(); i++) addStatic(staticProxies[i], false);
 }
 
-UnorderedPairMap& SortedAABBList::getCollisionPairs() {
-	static UnorderedPairMap collisionPairs;
-	static std::unordered_map<uint32_t, BoundingVolume*> collisionList;
-	collisionPairs.clear();
-	for (int i = 0; i < 3; i++) {
-		collisionList.clear();
-		for (Node* p = head[i]; p != nullptr; p = p->next[i]) {
-			if (!p->isMax) collisionList.emplace(p->index, p->boundingVolume);
-			else {
-				for (auto& pair : collisionList) {
-					if (pair.first == p->index) continue;
-					collisionPairs.emplace(std::pair<uint32_t, uint32_t>(p->index, pair.first), std::pair<BoundingVolume*, BoundingVolume*>(p->boundingVolume, pair.second));
-					collisionList.erase(p->index);
-				}
+bool SortedAABBList::rayCast(const Ray& ray, RayHit& hit, bool anyHit) const {
+	assert(dirtyProxies.empty() && insertedProxies.empty()); //flushUpdates first
+	hit = RayHit{};
+	//dynamics overlapping the ray's x extent start no further back than its low end minus the widest of them, the
+	//sorted x endpoints give that window and statics are left to their tree
+	float start = ray.origin.x;
+	float end = start + ray.direction.x * ray.maxDistance;
+	uint32_t low = toSortKey(std::min(start, end));
+	uint32_t high = toSortKey(std::max(start, end));
+	const std::vector<Endpoint>& axis = endpoints[0];
+	for (auto it = axis.begin() + firstCandidate(std::min(start, end)); it != axis.end() && it->key <= high; ++it) {
+		if (it->isMax) continue;
+		const Proxy& proxy = proxies[it->proxy];
+		if (proxy.index == UINT32_MAX || proxy.keys.max[0] < low) continue;
+		if (!closerHit(ray, proxy.index, proxy.boundingVolume, hit)) continue;
+		if (anyHit) return true;
+		//going up the axis, nothing starting past the hit can be closer
+		if (ray.direction.x >= 0.0f) high = toSortKey(start + ray.direction.x * hit.distance);
+	}
+	float enter;
+	auto hitStatic = [&ray, &hit, &enter](const StaticProxy& staticProxy) {
+		if (staticProxy.index == UINT32_MAX || !ray.clip(staticProxy.min, staticProxy.max, std::min(hit.distance, ray.maxDistance), enter)) return false;
+		return closerHit(ray, staticProxy.index, staticProxy.boundingVolume, hit);
+	};
+	if (!staticNodes.empty()) {
+		uint32_t stack[64];
+		int top = 0;
+		stack[top++] = 0;
+		while (top > 0) {
+			const StaticNode& node = staticNodes[stack[--top]];
+			if (!ray.clip(node.min, node.max, std::min(hit.distance, ray.maxDistance), enter)) continue;
+			if (node.left != UINT32_MAX) {
+				stack[top++] = node.left;
+				stack[top++] = node.right;
+				continue;
+			}
+			for (uint32_t i = node.first; i < node.first + node.count; i++) {
+				if (hitStatic(staticProxies[i]) && anyHit) return true;
 			}
 		}
 	}
-	return collisionPairs;
+	for (size_t i = builtStatics; i < staticProxies.size(); i++) {
+		if (hitStatic(staticProxies[i]) && anyHit) return true;
+	}
+	return hit.index != UINT32_MAX;
+}
+
+void SortedAABBList::getCollisionPairs(std::vector<CollisionPair>& out) const {
+	//kept up to date by insert/remove/update, nothing to rebuild here
+	for (auto& pair : collisionPairs) {
+		out.push_back(CollisionPair{ BoundingVolumePair{ pair.first.first, pair.second.first }, BoundingVolumePair{ pair.first.second, pair.second.second } });
+	}
 }
 
 void SortedAABBList::debugSizeCheck() {
 	for (int i = 0; i < 3; i++) {
-		uint32_t size = 0;
-		for (Node* p = head[i]; p != nullptr; p = p->next[i]) {
-			size++;
+		assert(endpoints[i].size() == 2 * (proxies.size() - freeProxies.size() - insertedProxies.size()));
+		for (uint32_t pos = 0; pos < endpoints[i].size(); pos++) {
+			const Endpoint& endpoint = endpoints[i][pos];
+			const Proxy& proxy = proxies[endpoint.proxy];
+			assert((endpoint.isMax ? proxy.maxPos[i] : proxy.minPos[i]) == pos);
 		}
-		assert(size == nodes.size());
 	}
 }
 
 void SortedAABBList::debugPrint() {
 	for (int i = 0; i < 3; i++) {
 		std::cout << i << ": ";
-		for (Node* p = head[i]; p != nullptr; p = p->next[i]) {
-			BoundingVolume* boundingVolume = p->boundingVolume;
-			float value;
-			if (p->isMax) {
-				value = boundingVolume->getCenter()[i] + boundingVolume->getHalfExtent()[i];
-			} else {
-				value = boundingVolume->getCenter()[i] - boundingVolume->getHalfExtent()[i];
-			}
-			if (p->next[i]) {
-				std::cout << "index: " << p->index << " value: " << value << ", ";
-			} else {
-				std::cout << "index: " << p->index << " value: " << value;
-			}
+		for (uint32_t pos = 0; pos < endpoints[i].size(); pos++) {
+			const Endpoint& endpoint = endpoints[i][pos];
+			const Proxy& proxy = proxies[endpoint.proxy];
+			if (proxy.index == UINT32_MAX) continue;
+			glm::vec3 value = proxy.boundingVolume->getCenter() + (endpoint.isMax ? 1.0f : -1.0f) * proxy.boundingVolume->getHalfExtent();
+			std::cout << "index: " << proxy.index << " value: " << value[i];
+			if (pos + 1 < endpoints[i].size()) std::cout << ", ";
 		}
 		std::cout << std::endl;
 	}
 	std::cout << std::endl;
-}
\ No newline at end of file
+}
+
+ProxyHandle SortedAABBArray::insert(uint32_t entityIndex, BoundingVolume* boundingVolume) {
+	assert(boundingVolume);
+	uint32_t slot;
+	if (!freeProxies.empty()) {
+		slot = freeProxies.back();
+		freeProxies.pop_back();
+	}
+	else {
+		slot = static_cast<uint32_t>(proxies.size());
+		proxies.emplace_back();
+	}
+	Proxy& proxy = proxies[slot];
+	proxy.index = entityIndex;
+	proxy.boundingVolume = boundingVolume;
+	proxy.keys.set(boundingVolume);
+	//keys and cross keys get filled in by the next sort
+	Endpoint endpoint;
+	endpoint.proxy = slot;
+	endpoints.push_back(endpoint);
+	endpoint.isMax = true;
+	endpoints.push_back(endpoint);
+	unsortedEndpoints += 2;
+	dirty = true;
+	return slot;
+}
+
+bool SortedAABBArray::remove(ProxyHandle proxy) {
+	if (proxy >= proxies.size() || proxies[proxy].index == UINT32_MAX) return false;
+	proxies[proxy].index = UINT32_MAX;
+	proxies[proxy].boundingVolume = nullptr;
+	removedProxies.push_back(proxy);
+	dirty = true;
+	return true;
+}
+
+bool SortedAABBArray::update(ProxyHandle proxy) {
+	//bounds are re-read and re-sorted once per frame in sort(), so moving an entity is just a flag
+	if (proxy >= proxies.size() || proxies[proxy].index == UINT32_MAX) return false;
+	dirty = true;
+	return true;
+}
+
+void SortedAABBArray::sort() {
+	if (!dirty) return;
+	if (!fixedAxis && sorts++ % sweepAxisInterval == 0) chooseAxis();
+	for (Proxy& proxy : proxies) {
+		if (proxy.index != UINT32_MAX) proxy.keys.set(proxy.boundingVolume);
+	}
+	if (!removedProxies.empty()) {
+		endpoints.erase(std::remove_if(endpoints.begin(), endpoints.end(), [this](const Endpoint& endpoint) {
+			return proxies[endpoint.proxy].index == UINT32_MAX;
+		}), endpoints.end());
+	}
+	int crossAxis1 = (sweepAxis + 1) % 3;
+	int crossAxis2 = (sweepAxis + 2) % 3;
+	for (Endpoint& endpoint : endpoints) {
+		const EndpointKeys& keys = proxies[endpoint.proxy].keys;
+		if (endpoint.isMax) {
+			endpoint.key = keys.max[sweepAxis];
+			continue;
+		}
+		endpoint.key = keys.min[sweepAxis];
+		//flipping the sign bit keeps the order under signed compares, SSE2 has no unsigned ones
+		endpoint.crossKeys[0] = static_cast<int32_t>(keys.min[crossAxis1] ^ 0x80000000u);
+		endpoint.crossKeys[1] = static_cast<int32_t>(keys.min[crossAxis2] ^ 0x80000000u);
+		endpoint.crossKeys[2] = static_cast<int32_t>(keys.max[crossAxis1] ^ 0x80000000u);
+		endpoint.crossKeys[3] = static_cast<int32_t>(keys.max[crossAxis2] ^ 0x80000000u);
+	}
+	if (unsortedEndpoints > endpoints.size() / 8) {
+		//lots of fresh endpoints appended at the back (e.g. scene load) or a new axis, insertion sort would go quadratic
+		std::sort(endpoints.begin(), endpoints.end(), [](const Endpoint& first, const Endpoint& second) {
+			return endpointLess(first.key, first.isMax, second.key, second.isMax);
+		});
+	}
+	else {
+		//frame to frame coherence keeps this close to linear
+		for (size_t j = 1; j < endpoints.size(); j++) {
+			Endpoint endpoint = endpoints[j];
+			size_t k = j;
+			while (k > 0 && endpointLess(endpoint.key, endpoint.isMax, endpoints[k - 1].key, endpoints[k - 1].isMax)) {
+				endpoints[k] = endpoints[k - 1];
+				k--;
+			}
+			endpoints[k] = endpoint;
+		}
+	}
+	freeProxies.insert(freeProxies.end(), removedProxies.begin(), removedProxies.end());
+	removedProxies.clear();
+	unsortedEndpoints = 0;
+	dirty = false;
+}
+
+void SortedAABBArray::chooseAxis() {
+	//the more spread out the centers are along the sweep axis the fewer boxes overlap on it alone, which
+	//is what the inner loop of the sweep walks over
+	double sum[3] = {}, sumSquares[3] = {};
+	size_t count = 0;
+	for (const Proxy& proxy : proxies) {
+		if (proxy.index == UINT32_MAX) continue;
+		glm::vec3 center = proxy.boundingVolume->getCenter();
+		float coords[3] = { center.x, center.y, center.z };
+		for (int i = 0; i < 3; i++) {
+			sum[i] += coords[i];
+			sumSquares[i] += static_cast<double>(coords[i]) * coords[i];
+		}
+		count++;
+	}
+	if (count < 2) return;
+	double variance[3];
+	for (int i = 0; i < 3; i++) variance[i] = sumSquares[i] / count - (sum[i] / count) * (sum[i] / count);
+	int best = variance[0] >= variance[1] ? (variance[0] >= variance[2] ? 0 : 2) : (variance[1] >= variance[2] ? 1 : 2);
+	//switching means a full re-sort, so not for a few percent
+	if (best == sweepAxis || variance[best] < 1.2 * variance[sweepAxis]) return;
+	sweepAxis = best;
+	unsortedEndpoints = endpoints.size();
+}
+
+void SortedAABBArray::getNearestObjects(ProxyHandle proxy, std::vector<BoundingVolumePair>& out) const {
+	assert(!dirty); //flushUpdates first
+	if (proxy >= proxies.size() || proxies[proxy].index == UINT32_MAX) return;
+	const Proxy& query = proxies[proxy];
+	for (const Endpoint& endpoint : endpoints) {
+		if (endpoint.key > query.keys.max[sweepAxis]) break;
+		if (endpoint.isMax || endpoint.proxy == proxy) continue;
+		const Proxy& other = proxies[endpoint.proxy];
+		if (!other.keys.overlaps(query.keys)) continue;
+		out.push_back(BoundingVolumePair{ other.index, other.boundingVolume });
+	}
+}
+
+void SortedAABBArray::queryFrustum(const Frustum& frustum, std::vector<BoundingVolumePair>& out) const {
+	for (const Proxy& proxy : proxies) {
+		if (proxy.index == UINT32_MAX) continue;
+		glm::vec3 center = proxy.boundingVolume->getCenter();
+		glm::vec3 halfExtent = proxy.boundingVolume->getHalfExtent();
+		if (frustum.test(center - halfExtent, center + halfExtent) != Frustum::Result::Outside) out.push_back(BoundingVolumePair{ proxy.index, proxy.boundingVolume });
+	}
+}
+
+bool SortedAABBArray::rayCast(const Ray& ray, RayHit& hit, bool anyHit) const {
+	assert(!dirty); //flushUpdates first
+	hit = RayHit{};
+	//only boxes overlapping the ray's extent along the sweep axis can be hit, which the sorted endpoints bound from above
+	float start = ray.origin[sweepAxis];
+	float end = start + ray.direction[sweepAxis] * ray.maxDistance;
+	uint32_t low = toSortKey(std::min(start, end));
+	uint32_t high = toSortKey(std::max(start, end));
+	for (const Endpoint& endpoint : endpoints) {
+		if (endpoint.key > high) break;
+		if (endpoint.isMax) continue;
+		const Proxy& proxy = proxies[endpoint.proxy];
+		if (proxy.index == UINT32_MAX || proxy.keys.max[sweepAxis] < low) continue;
+		if (!closerHit(ray, proxy.index, proxy.boundingVolume, hit)) continue;
+		if (anyHit) return true;
+		//going up the axis, nothing starting past the hit can be closer
+		if (ray.direction[sweepAxis] >= 0.0f) high = toSortKey(start + ray.direction[sweepAxis] * hit.distance);
+	}
+	return hit.index != UINT32_MAX;
+}
+
+//the cross keys of two min endpoints, apart as soon as either min lies past the other's max
+static inline bool crossOverlap(const int32_t* first, const int32_t* second) {
+#if HAS_SSE2
+	__m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(first));
+	__m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(second));
+	__m128i mins = _mm_unpacklo_epi64(a, b);
+	__m128i maxs = _mm_unpackhi_epi64(b, a);
+	return _mm_movemask_epi8(_mm_cmpgt_epi32(mins, maxs)) == 0;
+#else
+	return first[0] <= second[2] && first[1] <= second[3] && second[0] <= first[2] && second[1] <= first[3];
+#endif
+}
+
+void SortedAABBArray::sweep(size_t begin, size_t end, std::vector<CollisionPair>& out) const {
+	//from every min walk forward to the same box's max, each min passed on the way belongs to a box overlapping
+	//on the sweep axis, so only the cross keys stored right in the endpoint need checking and the proxy is only
+	//touched for actual pairs. every pair is found from whichever min comes first, so disjoint [begin, end)
+	//ranges can be swept independently
+	for (size_t i = begin; i < end; i++) {
+		const Endpoint& start = endpoints[i];
+		if (start.isMax) continue;
+		const Proxy& proxy = proxies[start.proxy];
+		uint32_t maxKey = proxy.keys.max[sweepAxis];
+		for (size_t j = i + 1; j < endpoints.size() && endpoints[j].key <= maxKey; j++) {
+			const Endpoint& endpoint = endpoints[j];
+			if (endpoint.isMax || !crossOverlap(start.crossKeys, endpoint.crossKeys)) continue;
+			const Proxy& otherProxy = proxies[endpoint.proxy];
+			out.push_back(CollisionPair{ BoundingVolumePair{ proxy.index, proxy.boundingVolume }, BoundingVolumePair{ otherProxy.index, otherProxy.boundingVolume } });
+		}
+	}
+}
+
+void SortedAABBArray::getCollisionPairs(std::vector<CollisionPair>& out) const {
+	assert(!dirty); //flushUpdates first
+	sweep(0, endpoints.size(), out);
+}
+
+void SortedAABBArray::getCollisionPairs(std::vector<CollisionPair>& out, JobSystem& jobs, WorkerPairs& workerPairs) const {
+	assert(!dirty);
+	clearWorkerPairs(jobs, workerPairs);
+	//small chunks so workers that land in a dense cluster don't hold everyone else up
+	jobs.parallelFor(static_cast<uint32_t>(endpoints.size()), 1024, [this, &workerPairs](uint32_t begin, uint32_t end, uint32_t worker) {
+		sweep(begin, end, workerPairs[worker]);
+	});
+	mergeWorkerPairs(out, jobs, workerPairs);
+}
@@ -10,6 +10,8 @@
 #include <unordered_map>
 #include <unordered_set>
 #include <functional>
+#include <memory>
+#include <cstring>
 
 template<typename T>
 struct UnorderedPairHash {
@@ -80,6 +82,11 @@ public:
 	}
 };
 
+//what SpatialPartition::insert hands back for the entity's later update/remove/query calls, so the partition
+//goes straight to its proxy instead of looking the entity up. only meaningful to the partition that made it
+using ProxyHandle = uint32_t;
+const ProxyHandle nullProxy = UINT32_MAX;
+
 class GameEntity {
 	friend class EntityManager;
 	static uint32_t entitiesCreated;
@@ -88,9 +95,13 @@ class GameEntity {
 	glm::vec3 scale{ 1.0f };
 	uint32_t index = UINT32_MAX;
 	BoundType boundType = BoundType::None;
+	uint32_t shape = UINT32_MAX; //slot in the entity manager's pool for boundType
+	ProxyHandle proxy = nullProxy;
 public:
 	uint32_t getIndex() const { return index; }
 	BoundType getBoundType() const { return boundType; }
+	uint32_t getShape() const { return shape; }
+	ProxyHandle getProxy() const { return proxy; }
 	glm::vec3 getPos() const { return pos; }
 	glm::vec3 getScale() const { return scale; }
 	friend bool operator ==(const GameEntity& first, const GameEntity& second) {
@@ -98,78 +109,391 @@ public:
 	}
 };
 
-bool loadModel(Mesh& mesh, const char* modelPath, unsigned int flags);
-
 using BoundingVolumePair = std::pair<uint32_t, BoundingVolume*>;
+using CollisionPair = std::pair<BoundingVolumePair, BoundingVolumePair>;
+//one pair buffer per worker for the parallel getCollisionPairs, kept by the caller between frames so it stops allocating
+using WorkerPairs = std::vector<std::vector<CollisionPair>>;
 
-class SpatialPartition {
-public:
-	virtual std::vector<BoundingVolumePair>& getNearestObjects(BoundingVolumePair& in) = 0;
-	virtual UnorderedPairMap& getCollisionPairs() = 0;
-	virtual void insert(uint32_t entityIndex, BoundingVolume* boundingVolume) = 0;
-	virtual bool remove(uint32_t entityIndex) = 0;
-	virtual bool update(uint32_t entityIndex) = 0;
+class JobSystem;
 
+struct RayHit {
+	uint32_t index = UINT32_MAX; //entity index, UINT32_MAX on a miss
+	BoundingVolume* boundingVolume = nullptr;
+	float distance = FLT_MAX; //along the ray, in multiples of its direction
 };
 
-class NullPartition : public SpatialPartition {
-public:
-	std::vector<BoundingVolumePair>& getNearestObjects(BoundingVolumePair& in) override;
-	void insert(uint32_t entityIndex, BoundingVolume* boundingVolume) override;
-	bool remove(uint32_t entityIndex) override;
-	bool update(uint32_t entityIndex) override;
-	std::unordered_map<uint32_t, BoundingVolume*> list;
+//floats mapped to unsigned keys with the same order (sign bit set on positives, every bit flipped on negatives),
+//so sorted endpoint lists compare plain integers instead of calling into the bounding volume
+inline uint32_t toSortKey(float value) {
+	value += 0.0f; //-0 becomes +0, the two have to tie
+	uint32_t bits;
+	std::memcpy(&bits, &value, sizeof(bits));
+	return bits ^ (static_cast<uint32_t>(static_cast<int32_t>(bits) >> 31) | 0x80000000u);
+}
+
+inline float fromSortKey(uint32_t key) {
+	uint32_t bits = key ^ ((key & 0x80000000u) ? 0x80000000u : 0xFFFFFFFFu);
+	float value;
+	std::memcpy(&value, &bits, sizeof(value));
+	return value;
+}
+
+//a proxy's bounds as sort keys, read from the bounding volume once per update
+struct EndpointKeys {
+	uint32_t min[3] = { 0, 0, 0 };
+	uint32_t max[3] = { 0, 0, 0 };
+	void set(BoundingVolume* boundingVolume) {
+		glm::vec3 center = boundingVolume->getCenter();
+		glm::vec3 halfExtent = boundingVolume->getHalfExtent();
+		for (int i = 0; i < 3; i++) {
+			min[i] = toSortKey(center[i] - halfExtent[i]);
+			max[i] = toSortKey(center[i] + halfExtent[i]);
+		}
+	}
+	bool overlaps(const EndpointKeys& other) const {
+		if (min[0] > other.max[0] || other.min[0] > max[0]) return false;
+		if (min[1] > other.max[1] || other.min[1] > max[1]) return false;
+		if (min[2] > other.max[2] || other.min[2] > max[2]) return false;
+		return true;
+	}
 };
 
-template<typename T1, typename T2>
-struct PairHash {
-	inline std::size_t operator()(const std::pair<T1, T2>& v) const {
-		std::size_t seed = 0;
-		hash_combine(seed, v.first);
-		hash_combine(seed, v.second);
-		return seed;
+//walks the cubic cells of width cellSize the ray passes through, in order, until limit (3D DDA, Amanatides and Woo).
+//func(coord, exit) is given where the ray leaves each cell and returns false to stop. returns false without walking
+//when that would take more than maxCells cells, so callers can fall back to something that doesn't scale with length
+template<typename Func>
+bool walkCells(const Ray& ray, float limit, float cellSize, float invCellSize, size_t maxCells, Func func) {
+	glm::vec3 first = glm::floor(ray.origin * invCellSize);
+	glm::vec3 last = glm::floor((ray.origin + ray.direction * limit) * invCellSize);
+	glm::vec3 span = glm::abs(last - first);
+	if (!(span.x + span.y + span.z < static_cast<float>(maxCells))) return false; //also catches rays running off to infinity
+	glm::ivec3 cell(first);
+	glm::ivec3 step(0);
+	glm::vec3 next(FLT_MAX); //where the ray crosses into the next cell along each axis
+	glm::vec3 delta(FLT_MAX); //how far it goes between two crossings
+	for (int i = 0; i < 3; i++) {
+		if (ray.direction[i] > 0.0f) {
+			step[i] = 1;
+			next[i] = ((first[i] + 1.0f) * cellSize - ray.origin[i]) * ray.invDirection[i];
+			delta[i] = cellSize * ray.invDirection[i];
+		}
+		else if (ray.direction[i] < 0.0f) {
+			step[i] = -1;
+			next[i] = (first[i] * cellSize - ray.origin[i]) * ray.invDirection[i];
+			delta[i] = -cellSize * ray.invDirection[i];
+		}
+	}
+	for (size_t visited = 0; visited <= maxCells; visited++) {
+		int axis = next.x < next.y ? (next.x < next.z ? 0 : 2) : (next.y < next.z ? 1 : 2);
+		float exit = next[axis];
+		if (!func(cell, exit) || exit >= limit) break;
+		cell[axis] += step[axis];
+		next[axis] += delta[axis];
+	}
+	return true;
+}
+
+class SpatialPartition {
+public:
+	//queries append to caller owned buffers and leave the partition untouched, so after flushUpdates any
+	//number of threads can query at once and a reused buffer stops allocating after the first few frames
+	virtual void getNearestObjects(ProxyHandle proxy, std::vector<BoundingVolumePair>& out) const = 0;
+	//everything whose box is at least partly inside the frustum, what the renderer draws
+	virtual void queryFrustum(const Frustum& frustum, std::vector<BoundingVolumePair>& out) const = 0;
+	//closest exact hit within the ray's maxDistance, or with anyHit the first one found, which is all a line of
+	//sight check needs. false on a miss
+	virtual bool rayCast(const Ray& ray, RayHit& hit, bool anyHit = false) const = 0;
+	//one hit per ray, hits is resized to match. rays next to each other that start close together and point the
+	//same way are cheaper in partitions that trace them as packets
+	void rayCastBatch(const std::vector<Ray>& rays, std::vector<RayHit>& hits, bool anyHit = false) const;
+	void rayCastBatch(const std::vector<Ray>& rays, std::vector<RayHit>& hits, bool anyHit, JobSystem& jobs) const;
+	virtual void getCollisionPairs(std::vector<CollisionPair>& out) const = 0;
+	//same pairs split across the job system's workers, partitions that can't split their work run the serial version
+	virtual void getCollisionPairs(std::vector<CollisionPair>& out, JobSystem&, WorkerPairs&) const { getCollisionPairs(out); }
+	virtual ProxyHandle insert(uint32_t entityIndex, BoundingVolume* boundingVolume) = 0;
+	//for geometry that is expected to never move, partitions may keep these apart and skip static-static pairs
+	virtual ProxyHandle insertStatic(uint32_t entityIndex, BoundingVolume* boundingVolume) { return insert(entityIndex, boundingVolume); }
+	//many proxies at once (scene load), partitions that can build in bulk override this. appends one handle
+	//per bounding volume to proxies, in the same order
+	virtual void insertBatch(const std::vector<BoundingVolumePair>& boundingVolumes, bool isStatic, std::vector<ProxyHandle>& proxies) {
+		for (const BoundingVolumePair& pair : boundingVolumes) {
+			if (isStatic) proxies.push_back(insertStatic(pair.first, pair.second));
+			else proxies.push_back(insert(pair.first, pair.second));
+		}
 	}
+	//false for handles that were already removed
+	virtual bool remove(ProxyHandle proxy) = 0;
+	virtual bool update(ProxyHandle proxy) = 0;
+	//moves are queued with markDirty and applied together by flushUpdates before querying, partitions
+	//that can apply a whole frame of moves in one pass override both
+	virtual void markDirty(ProxyHandle proxy) { dirtyProxies.push_back(proxy); }
+	virtual void flushUpdates() {
+		for (ProxyHandle proxy : dirtyProxies) update(proxy);
+		dirtyProxies.clear();
+	}
+	//same with the job system's workers helping, partitions that can't split their work run the serial version
+	virtual void flushUpdates(JobSystem&) { flushUpdates(); }
+protected:
+	std::vector<ProxyHandle> dirtyProxies;
+	//rays [0, count) of a batch, one at a time unless overridden
+	virtual void rayCastRange(const Ray* rays, RayHit* hits, size_t count, bool anyHit) const {
+		for (size_t i = 0; i < count; i++) rayCast(rays[i], hits[i], anyHit);
+	}
+	//exact test of one candidate, which replaces hit if it is closer
+	static bool closerHit(const Ray& ray, uint32_t index, BoundingVolume* boundingVolume, RayHit& hit) {
+		float distance;
+		if (!boundingVolume->intersect(ray, distance) || distance >= hit.distance) return false;
+		hit.index = index;
+		hit.boundingVolume = boundingVolume;
+		hit.distance = distance;
+		return true;
+	}
+	//sizes workerPairs for jobs and empties every buffer, keeping their capacity
+	static void clearWorkerPairs(JobSystem& jobs, WorkerPairs& workerPairs);
+	//appends every worker's pairs to out, each worker copying its own buffer into place
+	static void mergeWorkerPairs(std::vector<CollisionPair>& out, JobSystem& jobs, WorkerPairs& workerPairs);
+};
+
+class NullPartition : public SpatialPartition {
+public:
+	void getNearestObjects(ProxyHandle proxy, std::vector<BoundingVolumePair>& out) const override;
+	void queryFrustum(const Frustum& frustum, std::vector<BoundingVolumePair>& out) const override;
+	bool rayCast(const Ray& ray, RayHit& hit, bool anyHit = false) const override;
+	void getCollisionPairs(std::vector<CollisionPair>& out) const override;
+	using SpatialPartition::getCollisionPairs;
+	ProxyHandle insert(uint32_t entityIndex, BoundingVolume* boundingVolume) override;
+	bool remove(ProxyHandle proxy) override;
+	bool update(ProxyHandle proxy) override;
+	void clear();
+	std::vector<BoundingVolumePair> list; //indexed by handle, entity index UINT32_MAX while the slot is free
+private:
+	std::vector<ProxyHandle> freeSlots;
 };
 
+//handles are slots in proxies, statics get staticHandle set and index staticSlots instead
 class SortedAABBList : public SpatialPartition {
 public:
-	std::vector<BoundingVolumePair>& getNearestObjects(BoundingVolumePair& in) override;
-	void insert(uint32_t entityIndex, BoundingVolume* boundingVolume) override;
-	bool remove(uint32_t entityIndex) override;
-	bool update(uint32_t entityIndex) override;
-	UnorderedPairMap& getCollisionPairs();
+	void getNearestObjects(ProxyHandle proxy, std::vector<BoundingVolumePair>& out) const override;
+	void queryFrustum(const Frustum& frustum, std::vector<BoundingVolumePair>& out) const override;
+	bool rayCast(const Ray& ray, RayHit& hit, bool anyHit = false) const override;
+	ProxyHandle insert(uint32_t entityIndex, BoundingVolume* boundingVolume) override;
+	ProxyHandle insertStatic(uint32_t entityIndex, BoundingVolume* boundingVolume) override;
+	void insertBatch(const std::vector<BoundingVolumePair>& boundingVolumes, bool isStatic, std::vector<ProxyHandle>& handles) override;
+	bool remove(ProxyHandle proxy) override;
+	bool update(ProxyHandle proxy) override;
+	void flushUpdates() override; //inserts and moves only show up in queries after this
+	using SpatialPartition::flushUpdates;
+	void getCollisionPairs(std::vector<CollisionPair>& out) const override;
+	using SpatialPartition::getCollisionPairs; //the pair map is already there, nothing worth splitting
 private:
-	struct Node {
-		uint32_t index = UINT32_MAX;
-		Node* prev[3] = { nullptr, nullptr, nullptr };
-		Node* next[3] = { nullptr, nullptr, nullptr };
+	//one sorted endpoint array per axis, 8 bytes an endpoint. the box is stored once in its proxy together
+	//with where its endpoints sit, so an update can start swapping without searching for them. that is 112 of
+	//the ~128 bytes a dynamic costs in all (10k uniform, pairs and static links included)
+	struct Endpoint {
+		uint32_t key;
+		uint32_t proxy : 31; //slot in proxies, not the entity index
+		uint32_t isMax : 1;
+	};
+	struct Proxy {
+		EndpointKeys keys;
+		uint32_t minPos[3] = { 0, 0, 0 }; //slots in endpoints
+		uint32_t maxPos[3] = { 0, 0, 0 };
 		BoundingVolume* boundingVolume = nullptr;
-		bool isMax = false;
+		uint32_t index = UINT32_MAX; //entity index, UINT32_MAX while the slot is free
+	};
+	std::vector<Endpoint> endpoints[3];
+	std::vector<Proxy> proxies;
+	std::vector<uint32_t> freeProxies;
+	std::vector<uint32_t> removedProxies; //endpoints still in the arrays, freed once enough pile up to compact
+	std::vector<uint32_t> insertedProxies; //endpoints not in the arrays yet, flushUpdates merges them in
+	UnorderedPairMap collisionPairs; //persistent, edited as endpoints cross instead of rebuilt every frame
+	//static geometry stays out of the sorted lists and lives in a flat bounding volume hierarchy that
+	//is only rebuilt once enough statics were added or removed, statics inserted since then are
+	//checked linearly until the next rebuild
+	static constexpr ProxyHandle staticHandle = 0x80000000u;
+	struct StaticProxy {
+		glm::vec3 min{ 0.0f };
+		glm::vec3 max{ 0.0f };
+		uint32_t index = UINT32_MAX; //entity index, UINT32_MAX once removed
+		uint32_t handle = UINT32_MAX; //slot in staticSlots
+		BoundingVolume* boundingVolume = nullptr;
+	};
+	struct StaticNode {
+		glm::vec3 min{ 0.0f };
+		glm::vec3 max{ 0.0f };
+		uint32_t left = UINT32_MAX; //UINT32_MAX for leaves
+		uint32_t right = UINT32_MAX;
+		uint32_t first = 0; //leaves only, range in staticProxies
+		uint32_t count = 0;
+	};
+	std::vector<StaticProxy> staticProxies;
+	std::vector<StaticNode> staticNodes;
+	std::vector<uint32_t> staticSlots; //static handle to slot in staticProxies, which the tree build reorders
+	std::vector<uint32_t> freeStaticHandles;
+	//every dynamic-static overlap is one link sitting in two doubly linked lists, the dynamic's and the static's,
+	//so either end can drop it without searching. moving a static or asking for its neighbours only walks its own
+	//list, and the links share one pool instead of a vector per proxy
+	struct StaticLink {
+		uint32_t slot; //proxy slot of the dynamic
+		uint32_t handle; //static handle
+		uint32_t next[2]; //in the dynamic's list [0] and the static's list [1], UINT32_MAX at the end
+		uint32_t prev[2];
 	};
-	std::unordered_map<std::pair<uint32_t, bool>, Node, PairHash<uint32_t, bool>> nodes;
-	Node* head[3] = { nullptr, nullptr, nullptr };
-	void insertHelper(Node* node);
-	void updateHelper(decltype(nodes)::iterator it);
-	void swap(int i, Node* first, Node* second);
+	std::vector<StaticLink> staticLinks;
+	std::vector<uint32_t> freeStaticLinks;
+	std::vector<uint32_t> staticOverlaps; //per proxy slot, first link to the statics it overlaps
+	std::vector<uint32_t> staticDynamics; //per static handle, first link to the dynamics overlapping it
+	float maxExtent = 0.0f; //widest dynamic on x since the last compact, bounds how far back addStatic looks
+	size_t builtStatics = 0;
+	size_t removedStatics = 0;
+	void buildStaticTree();
+	uint32_t buildStaticNode(uint32_t first, uint32_t count);
+	template<typename Func>
+	void queryStatic(const glm::vec3& min, const glm::vec3& max, Func func);
+	void refreshStaticPairs(uint32_t slot);
+	void linkStatic(uint32_t slot, uint32_t handle);
+	void unlinkStatic(uint32_t link);
+	void clearStaticPairs(uint32_t slot);
+	void growExtent(const Proxy& proxy) { maxExtent = std::max(maxExtent, fromSortKey(proxy.keys.max[0]) - fromSortKey(proxy.keys.min[0])); }
+	//first x endpoint of a dynamic that may overlap something starting at min on x. its min is no further back
+	//than that minus the widest dynamic, doubled so rounding in the subtraction can't cut it off
+	uint32_t firstCandidate(float min) const;
+	uint32_t allocateStaticHandle();
+	void addStatic(uint32_t handle, uint32_t entityIndex, BoundingVolume* boundingVolume);
+	void removeStatic(uint32_t handle); //the handle stays taken, moved statics are added back under it
+	const StaticProxy& getStatic(uint32_t handle) const { return staticProxies[staticSlots[handle]]; }
+	bool isLiveStatic(uint32_t handle) const { return handle < staticSlots.size() && staticSlots[handle] != UINT32_MAX; }
+	bool isLive(uint32_t slot) const { return slot < proxies.size() && proxies[slot].index != UINT32_MAX; }
+	bool isInserted(uint32_t slot) const { return proxies[slot].minPos[0] == UINT32_MAX; } //waiting for the flush
+	void mergeInserted();
+	uint32_t allocateProxy(uint32_t entityIndex, BoundingVolume* boundingVolume);
+	void refreshKeys(Proxy& proxy);
+	void setEndpoint(int i, uint32_t pos, Endpoint endpoint);
+	void renumber(int i, uint32_t first);
+	void compact();
+	void moveEndpoint(int i, uint32_t pos);
+	void sortAxis(int i);
+	void addPair(uint32_t first, uint32_t second);
+	void removePair(uint32_t first, uint32_t second);
 	void debugPrint();
 	void debugSizeCheck();
 };
 
+//sort and sweep along a single axis, by default whichever one the centers are most spread along (checked
+//again every sweepAxisInterval sorts). the other two axes are tested inline from keys copied into the endpoints
+class SortedAABBArray : public SpatialPartition {
+public:
+	SortedAABBArray(int axis = -1) : sweepAxis{ axis < 0 ? 0 : axis }, fixedAxis{ axis >= 0 } {} //0-2 pins the sweep axis
+	void getNearestObjects(ProxyHandle proxy, std::vector<BoundingVolumePair>& out) const override;
+	void queryFrustum(const Frustum& frustum, std::vector<BoundingVolumePair>& out) const override;
+	bool rayCast(const Ray& ray, RayHit& hit, bool anyHit = false) const override;
+	ProxyHandle insert(uint32_t entityIndex, BoundingVolume* boundingVolume) override;
+	bool remove(ProxyHandle proxy) override;
+	bool update(ProxyHandle proxy) override;
+	void markDirty(ProxyHandle) override { dirty = true; } //everything gets re-sorted anyway
+	void flushUpdates() override { sort(); } //inserts, removes and moves only show up in queries after this
+	using SpatialPartition::flushUpdates;
+	void getCollisionPairs(std::vector<CollisionPair>& out) const override;
+	void getCollisionPairs(std::vector<CollisionPair>& out, JobSystem& jobs, WorkerPairs& workerPairs) const override;
+	int getSweepAxis() const { return sweepAxis; }
+private:
+	struct Endpoint {
+		uint32_t key = 0;
+		uint32_t proxy = UINT32_MAX; //slot in proxies, not the entity index
+		bool isMax = false;
+		int32_t crossKeys[4] = {}; //min endpoints only, the other two axes as min, min, max, max with the sign bit flipped
+	};
+	struct Proxy {
+		uint32_t index = UINT32_MAX; //entity index, UINT32_MAX while the slot is free
+		BoundingVolume* boundingVolume = nullptr;
+		EndpointKeys keys;
+	};
+	std::vector<Endpoint> endpoints; //kept sorted by key along sweepAxis
+	std::vector<Proxy> proxies;
+	std::vector<uint32_t> freeProxies;
+	std::vector<uint32_t> removedProxies; //freed only after their endpoints are compacted away
+	size_t unsortedEndpoints = 0;
+	bool dirty = false;
+	int sweepAxis;
+	bool fixedAxis;
+	uint32_t sorts = 0;
+	void sort();
+	void chooseAxis();
+	void sweep(size_t begin, size_t end, std::vector<CollisionPair>& out) const;
+};
+
+//every record of one shape kind, in chunks of chunkSize so they stay where they are while the pool grows and
+//partitions can keep pointing at them. freed slots are handed out again before the pool grows
+template<typename Shape>
+class ShapePool {
+public:
+	static constexpr uint32_t chunkSize = 1024;
+	uint32_t add(uint32_t entityIndex, const Shape& shape) {
+		uint32_t slot;
+		if (!freeSlots.empty()) {
+			slot = freeSlots.back();
+			freeSlots.pop_back();
+			owners[slot] = entityIndex;
+		}
+		else {
+			slot = static_cast<uint32_t>(owners.size());
+			if (slot % chunkSize == 0) chunks.emplace_back(new Shape[chunkSize]);
+			owners.push_back(entityIndex);
+		}
+		(*this)[slot] = shape;
+		return slot;
+	}
+	void remove(uint32_t slot) {
+		owners[slot] = UINT32_MAX;
+		freeSlots.push_back(slot);
+	}
+	Shape& operator[](uint32_t slot) { return chunks[slot / chunkSize][slot % chunkSize]; }
+	const Shape& operator[](uint32_t slot) const { return chunks[slot / chunkSize][slot % chunkSize]; }
+	uint32_t getOwner(uint32_t slot) const { return owners[slot]; } //entity index, UINT32_MAX for a free slot
+	uint32_t size() const { return static_cast<uint32_t>(owners.size()); } //slots handed out so far, free ones included
+private:
+	std::vector<std::unique_ptr<Shape[]>> chunks;
+	std::vector<uint32_t> owners;
+	std::vector<uint32_t> freeSlots;
+};
+
 class EntityManager {
 public:
 	EntityManager(SpatialPartition& spatialPartition) : spatialPartition{ spatialPartition } {}
 	~EntityManager() {}
 	void setPos(uint32_t index, glm::vec3& pos);
+	//setPos for many sphere entities at once, indices[i] moves to positions[i]. spheres only translate, so
+	//their model matrices keep the scale and just get the new translation
+	void setSpherePositions(const std::vector<uint32_t>& indices, const std::vector<glm::vec3>& positions);
 	void setScale(uint32_t index, glm::vec3 scale);
+	//AABB entities are static geometry, partitions may keep them apart and make moving them slow
 	uint32_t createEntity(Mesh mesh, BoundType boundType, glm::vec3 pos = glm::vec3{ 0.0f }, glm::vec3 scale = glm::vec3{ 1.0f });
-	bool destroyEntity(uint32_t index);
+	//creates meshes.size() entities with consecutive indices and hands them to the partition in one batch, returns the first index
+	uint32_t createEntities(const std::vector<Mesh>& meshes, const std::vector<BoundType>& boundTypes, const std::vector<glm::vec3>& positions, const std::vector<glm::vec3>& scales);
+	bool destroyEntity(uint32_t index); //a rigid body the entity had stays, PhysicsManager::removeBody drops it
+	//the header of the entity's shape record, nullptr for entities without one
+	BoundingVolume* getBoundingVolume(const GameEntity& gameEntity);
 	std::unordered_map<uint32_t, GameEntity> gameEntities;
 	std::unordered_map<uint32_t, Renderable> renderables;
-	std::unordered_map<uint32_t, AABB> aabbs;
-	std::unordered_map<uint32_t, BoundingSphere> boundingSpheres;
+	//shape records by kind, a GameEntity's boundType and shape slot pick its record
+	ShapePool<AABB> aabbs;
+	ShapePool<BoundingSphere> boundingSpheres;
 	SpatialPartition& spatialPartition;
+private:
+	BoundingVolumePair addEntity(Mesh& mesh, BoundType boundType, glm::vec3 pos, glm::vec3 scale);
 };
 
+//entity data as it is stored in scene files, without meshes so tools can read and write scenes headless
+struct SceneData {
+	std::vector<BoundType> boundTypes;
+	std::vector<glm::vec3> positions;
+	std::vector<glm::vec3> scales;
+};
+
+bool readScene(const char* path, SceneData& sceneData);
+
+bool writeScene(const char* path, const SceneData& sceneData);
+
 void loadScene(EntityManager& entityManager, const char* path, Mesh& cubeMesh, Mesh& sphereMesh);
 
 void storeScene(EntityManager& entityManager, const char* path);
\ No newline at end of file
@@ -0,0 +1,122 @@
+#include "scenegen.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <random>
+
+//std distributions are implemented differently by each standard library, only the raw mt19937 sequence
+//is pinned down, so all the sampling is done here on top of it
+class SceneRandom {
+public:
+	SceneRandom(uint32_t seed) : engine{ seed } {}
+	float uniform(float min, float max) {
+		return min + (max - min) * static_cast<float>(engine() >> 8) * (1.0f / 16777216.0f);
+	}
+	float normal() { //box muller
+		float u1 = (static_cast<float>(engine() >> 8) + 1.0f) * (1.0f / 16777217.0f);
+		float u2 = uniform(0.0f, 1.0f);
+		return std::sqrt(-2.0f * std::log(u1)) * std::cos(6.28318530718f * u2);
+	}
+	bool chance(float probability) { return uniform(0.0f, 1.0f) < probability; }
+private:
+	std::mt19937 engine;
+};
+
+static const char* layoutNames[] = { "uniform", "clusters", "towers", "lattice", "heavy" };
+
+//size is the full width, spheres get it as their diameter and boxes are stretched a little per axis unless exact
+static void addEntity(SceneData& scene, SceneRandom& random, float sphereFraction, glm::vec3 pos, float size, bool exact) {
+	if (random.chance(sphereFraction)) {
+		scene.boundTypes.push_back(BoundType::Sphere);
+		scene.scales.push_back(glm::vec3(size * 0.5f));
+	}
+	else {
+		scene.boundTypes.push_back(BoundType::AABB);
+		glm::vec3 stretch{ 1.0f };
+		if (!exact) stretch = glm::vec3(random.uniform(0.75f, 1.25f), random.uniform(0.75f, 1.25f), random.uniform(0.75f, 1.25f));
+		scene.scales.push_back(size * stretch);
+	}
+	scene.positions.push_back(pos);
+}
+
+SceneData generateScene(const SceneParams& params) {
+	SceneData scene;
+	scene.boundTypes.reserve(params.count);
+	scene.positions.reserve(params.count);
+	scene.scales.reserve(params.count);
+	SceneRandom random(params.seed);
+	float halfWidth = 0.5f * params.spacing * std::cbrt(static_cast<float>(params.count));
+	auto uniformPos = [&random, halfWidth]() {
+		return glm::vec3(random.uniform(-halfWidth, halfWidth), random.uniform(-halfWidth, halfWidth), random.uniform(-halfWidth, halfWidth));
+	};
+	switch (params.layout) {
+	case SceneLayout::Uniform:
+		for (uint32_t i = 0; i < params.count; i++) {
+			glm::vec3 pos = uniformPos();
+			addEntity(scene, random, params.sphereFraction, pos, random.uniform(0.5f, 1.5f), false);
+		}
+		break;
+	case SceneLayout::Clusters:
+	{
+		//blobs of about 500 spread over the same volume as uniform, a few times denser at their cores
+		const uint32_t perCluster = 500;
+		std::vector<glm::vec3> centers((params.count + perCluster - 1) / perCluster);
+		for (glm::vec3& center : centers) center = uniformPos();
+		float sigma = 0.2f * params.spacing * std::cbrt(static_cast<float>(perCluster));
+		for (uint32_t i = 0; i < params.count; i++) {
+			glm::vec3 offset(random.normal(), random.normal(), random.normal());
+			glm::vec3 pos = centers[i % centers.size()] + offset * sigma;
+			addEntity(scene, random, params.sphereFraction, pos, random.uniform(0.5f, 1.5f), false);
+		}
+		break;
+	}
+	case SceneLayout::Towers:
+	{
+		//columns of 16 unit sized entities resting on each other, standing spacing apart on the xz plane
+		const uint32_t levels = 16;
+		uint32_t towers = (params.count + levels - 1) / levels;
+		uint32_t side = static_cast<uint32_t>(std::ceil(std::sqrt(static_cast<float>(towers))));
+		for (uint32_t i = 0; i < params.count; i++) {
+			uint32_t tower = i / levels;
+			float x = (static_cast<float>(tower % side) - 0.5f * side) * params.spacing;
+			float z = (static_cast<float>(tower / side) - 0.5f * side) * params.spacing;
+			glm::vec3 pos(x, static_cast<float>(i % levels) + 0.5f, z);
+			addEntity(scene, random, params.sphereFraction, pos, 1.0f, true);
+		}
+		break;
+	}
+	case SceneLayout::Lattice:
+	{
+		//unit cube grid, every entity exactly touching its neighbours so lots of endpoints tie
+		uint32_t side = static_cast<uint32_t>(std::ceil(std::cbrt(static_cast<float>(params.count))));
+		for (uint32_t i = 0; i < params.count; i++) {
+			glm::vec3 cell(static_cast<float>(i % side), static_cast<float>((i / side) % side), static_cast<float>(i / (side * side)));
+			addEntity(scene, random, params.sphereFraction, cell - glm::vec3(0.5f * side), 1.0f, true);
+		}
+		break;
+	}
+	case SceneLayout::HeavyTailed:
+		//pareto sized, mostly small with a few entities spanning a good part of the scene
+		for (uint32_t i = 0; i < params.count; i++) {
+			glm::vec3 pos = uniformPos();
+			float size = 0.5f * std::pow(1.0f - random.uniform(0.0f, 1.0f), -1.0f / 1.5f);
+			addEntity(scene, random, params.sphereFraction, pos, std::min(size, 0.5f * halfWidth), false);
+		}
+		break;
+	}
+	return scene;
+}
+
+const char* getLayoutName(SceneLayout layout) {
+	return layoutNames[static_cast<int>(layout)];
+}
+
+bool parseLayout(const char* name, SceneLayout& layout) {
+	for (int i = 0; i < static_cast<int>(sizeof(layoutNames) / sizeof(layoutNames[0])); i++) {
+		if (std::strcmp(name, layoutNames[i]) == 0) {
+			layout = static_cast<SceneLayout>(i);
+			return true;
+		}
+	}
+	return false;
+}
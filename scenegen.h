@@ -0,0 +1,20 @@
+#pragma once
+#include "scene.h"
+
+//synthetic scenes for stress testing, written with writeScene they load like any other scene file
+enum class SceneLayout { Uniform, Clusters, Towers, Lattice, HeavyTailed };
+
+struct SceneParams {
+	uint32_t count = 1000;
+	SceneLayout layout = SceneLayout::Uniform;
+	float sphereFraction = 0.5f; //the rest are boxes
+	uint32_t seed = 1;
+	float spacing = 3.0f; //average distance between neighbouring entities, sizes are around 1
+};
+
+//same params and seed give the same scene on every platform
+SceneData generateScene(const SceneParams& params);
+
+const char* getLayoutName(SceneLayout layout);
+
+bool parseLayout(const char* name, SceneLayout& layout);